@@ -1,13 +1,11 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
-layout (set = 1, binding = 1) uniform Variables 
-{
-	vec3 color;
-} variables;
+#include "ObjectData.glsl"
 
 layout (location = 0) out vec3 outFragColor;
 
 void main()
 {
-	outFragColor = variables.color;
+	outFragColor = objects.data[objectConstants.index].color.rgb;
 }
\ No newline at end of file
@@ -1,19 +1,12 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
 layout (location = 0) in vec3 inPos;
 
-layout (set = 0, binding = 0) uniform ViewMatrices
-{
-	mat4 projection;
-	mat4 view;
-} viewMatrices;
-
-layout (set = 1, binding = 0) uniform ModelMatrix 
-{
-	mat4 model;
-} modelMatrix;
+#include "ViewMatrices.glsl"
+#include "ObjectData.glsl"
 
 void main()
 {
-	gl_Position = viewMatrices.projection * viewMatrices.view * modelMatrix.model * vec4(inPos.xyz, 1.0);
+	gl_Position = viewMatrices.projection * viewMatrices.view * objects.data[objectConstants.index].model * vec4(inPos.xyz, 1.0);
 }
@@ -1,23 +1,22 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec2 inTexCoord;
 
-layout (set = 0, binding = 0) uniform ViewMatrices
-{
-	mat4 projection;
-	mat4 view;
-} viewMatrices;
-
-layout (set = 1, binding = 0) uniform ModelMatrix 
-{
-	mat4 model;
-} modelMatrix;
+#include "ViewMatrices.glsl"
+#include "ObjectData.glsl"
 
 layout (location = 0) out vec2 outTexCood;
+#ifdef BINDLESS
+layout (location = 1) flat out uint outTextureIndex;
+#endif
 
 void main()
 {
 	outTexCood = inTexCoord;
-	gl_Position = viewMatrices.projection * viewMatrices.view * modelMatrix.model * vec4(inPos.xyz, 1.0);
+#ifdef BINDLESS
+	outTextureIndex = objects.data[objectConstants.index].textureIndex;
+#endif
+	gl_Position = viewMatrices.projection * viewMatrices.view * objects.data[objectConstants.index].model * vec4(inPos.xyz, 1.0);
 }
@@ -1,6 +1,15 @@
 #version 450
 
-layout (set = 1, binding = 1) uniform sampler2D colorSampler;
+#ifdef BINDLESS
+#extension GL_EXT_nonuniform_qualifier : require
+// The texture table, indexed per object. The index is uniform within a draw, which
+// shaderSampledImageArrayDynamicIndexing covers
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+layout (location = 1) flat in uint inTextureIndex;
+#	define colorSampler textures[inTextureIndex]
+#else
+layout (set = 1, binding = 0) uniform sampler2D colorSampler;
+#endif
 
 layout (location = 0) in vec2 inTexCoord;
 
@@ -0,0 +1,17 @@
+struct ObjectData
+{
+	mat4 model;
+	vec4 color;
+	uint textureIndex; // into the texture table, in bindless mode
+};
+
+// Data of all scene objects for the current frame, indexed by the object index pushed per draw
+layout (set = 0, binding = 1) readonly buffer Objects
+{
+	ObjectData data[];
+} objects;
+
+layout (push_constant) uniform ObjectConstants
+{
+	uint index;
+} objectConstants;
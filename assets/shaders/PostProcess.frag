@@ -1,5 +1,9 @@
 #version 450
 
+// Permutation features, see PostProcessor
+layout (constant_id = 0) const bool GRAYSCALE = false;
+layout (constant_id = 1) const bool VIGNETTE = false;
+
 layout (binding = 0) uniform sampler2D colorSampler;
 
 layout (location = 0) in vec2 inTexCoord;
@@ -8,5 +12,16 @@ layout (location = 0) out vec3 outFragColor;
 void main()
 {
 	vec4 color = texture(colorSampler, inTexCoord, 1);
-	outFragColor = color.rgb;
-}
\ No newline at end of file
+	vec3 result = color.rgb;
+
+	if (GRAYSCALE)
+		result = vec3(dot(result, vec3(0.299, 0.587, 0.114)));
+
+	if (VIGNETTE)
+	{
+		vec2 uv = inTexCoord * (1.0 - inTexCoord);
+		result *= clamp(pow(uv.x * uv.y * 16.0, 0.25), 0.0, 1.0);
+	}
+
+	outFragColor = result;
+}
@@ -0,0 +1,5 @@
+layout (set = 0, binding = 0) uniform ViewMatrices
+{
+	mat4 projection;
+	mat4 view;
+} viewMatrices;
@@ -9,6 +9,12 @@
 #include <fstream>
 #include <cassert>
 
+bool fs::exists(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return file.is_open();
+}
+
 auto fs::readBytes(const std::string& path) -> std::vector<uint8_t>
 {
     std::ifstream file(path, std::ios::binary | std::ios::ate);
@@ -25,6 +31,14 @@ auto fs::readBytes(const std::string& path) -> std::vector<uint8_t>
     return data;
 }
 
+void fs::writeBytes(const std::string &path, const void *data, size_t size)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    KL_PANIC_IF(!file.is_open(), "Failed to open file for writing");
+    file.write(reinterpret_cast<const char *>(data), size);
+    file.close();
+}
+
 void fs::iterateLines(const std::string &path, std::function<bool(const std::string &)> process)
 {
     std::ifstream file(path);
@@ -10,7 +10,9 @@
 
 namespace fs
 {
+    bool exists(const std::string &path);
     auto readBytes(const std::string &path) -> std::vector<uint8_t>;
+    void writeBytes(const std::string &path, const void *data, size_t size);
     void iterateLines(const std::string &path, std::function<bool(const std::string &)> process);
     auto getStream(const std::string &path) -> std::ifstream;
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace hashutils
+{
+    // 64-bit FNV-1a, stable across runs and platforms (unlike std::hash), so it's safe to use for on-disk keys
+    inline auto fnv1a(const void *data, size_t size, uint64_t seed = 14695981039346656037ull) -> uint64_t
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(data);
+        auto hash = seed;
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    template <class T>
+    void combine(size_t &seed, const T &value)
+    {
+        seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+}
@@ -1,6 +1,5 @@
 // TODO Refactor ImageData/Font using pointers avoiding pimpl
 // TODO Font geometry and rendering
-// TODO Use shaderc (see Granite project on Github)
 
 /*
     Copyright (c) Aleksey Fedotov
@@ -15,20 +14,40 @@
 #include "ImageData.h"
 #include "MeshData.h"
 #include "Font.h"
+#include "ShaderCompiler.h"
+#include "ThreadPool.h"
 #include "Vulkan/Vulkan.h"
 #include "Vulkan/VulkanDevice.h"
 #include "Vulkan/VulkanRenderPass.h"
 #include "Vulkan/VulkanSwapchain.h"
 #include "Vulkan/VulkanDescriptorPool.h"
+#include "Vulkan/VulkanDescriptorAllocator.h"
 #include "Vulkan/VulkanBuffer.h"
+#include "Vulkan/VulkanRingBuffer.h"
 #include "Vulkan/VulkanPipeline.h"
+#include "Vulkan/VulkanPipelineCache.h"
+#include "Vulkan/VulkanComputePipeline.h"
+#include "Vulkan/VulkanShaderReflection.h"
 #include "Vulkan/VulkanDescriptorSetLayoutBuilder.h"
 #include "Vulkan/VulkanImage.h"
 #include "Vulkan/VulkanDescriptorSetUpdater.h"
+#include "Vulkan/VulkanTextureTable.h"
+#include "Vulkan/VulkanParallelRecorder.h"
+#include "Vulkan/VulkanCommandBundleCache.h"
+#include "Vulkan/VulkanRenderGraph.h"
+#include "Vulkan/VulkanQueueScheduler.h"
+#include "Vulkan/VulkanGpuProfiler.h"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.inl>
 #include <glm/gtc/matrix_transform.inl>
 #include <vector>
+#include <array>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <utility>
 
 static const std::vector<float> xAxisVertexData = 
 {
@@ -62,39 +81,74 @@ static const std::vector<float> quadVertexData =
 class Scene
 {
 public:
-    Scene(const vk::Device &device)
+    // In bindless mode textures of 2D-textured objects go into a texture table instead of sets of their own
+    // Uniform data is kept per frame in flight
+    Scene(const vk::Device &device, ThreadPool &threadPool, uint32_t frameCount, bool bindless):
+        shaderCompiler("ShaderCache_", {"../../assets/shaders"}),
+        pipelineCache(device, threadPool)
     {
-        viewMatricesBuffer = vk::Buffer::createUniformHostVisible(device, sizeof(viewMatrices));
-
-        descPool = vk::DescriptorPool(device, 20, vk::DescriptorPoolConfig()
-            .forDescriptors(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 20)
-            .forDescriptors(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 20));
-
-        descSetLayout = vk::DescriptorSetLayoutBuilder(device)
-            .withBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
-            .build();
-        descSet = descPool.allocateSet(descSetLayout);
+        uniformRing = vk::RingBuffer(device, 64 * 1024, frameCount);
+        if (bindless)
+            textureTable = std::make_unique<vk::TextureTable>(device, maxTextureCount);
+
+        descAllocator = vk::DescriptorAllocator(device, 16, vk::DescriptorPoolConfig()
+            .forDescriptors(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 16)
+            .forDescriptors(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 16)
+            .forDescriptors(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 16));
+
+        // Matches set 0 as reflected from the shaders (see ViewMatrices.glsl and ObjectData.glsl) with the buffers
+        // made dynamic, so the set is compatible with all scene pipelines
+        descSetLayout = pipelineCache.getDescriptorSetLayout(vk::DescriptorSetLayoutBuilder(device)
+            .withBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
+            .withBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_ALL_GRAPHICS));
+        descSet = descAllocator.getSet(descSetLayout, vk::DescriptorBindings()
+            .withDynamicUniformBuffer(0, uniformRing.getHandle(), sizeof(viewMatrices))
+            .withDynamicStorageBuffer(1, uniformRing.getHandle(), sizeof(ObjectData) * maxObjectCount));
+    }
 
-        vk::DescriptorSetUpdater(device)
-            .forUniformBuffer(0, descSet, viewMatricesBuffer, 0, sizeof(viewMatrices))
-            .updateSets();
+    // Returns the index to push when drawing the object. The transform must outlive the scene.
+    auto addObject(const Transform &transform, const glm::vec4 &color = glm::vec4{1.0f}, uint32_t textureIndex = 0) -> uint32_t
+    {
+        KL_PANIC_IF(objects.size() >= maxObjectCount, "Too many scene objects");
+        objects.push_back({&transform, color, textureIndex});
+        return static_cast<uint32_t>(objects.size() - 1);
     }
 
     void update(const Camera &cam)
     {
         viewMatrices.proj = cam.getProjectionMatrix();
         viewMatrices.view = cam.getViewMatrix();
-        viewMatricesBuffer.update(&viewMatrices);
+
+        uniformRing.beginFrame();
+        dynamicOffsets[0] = uniformRing.push(viewMatrices);
+
+        // Data of all objects is written in one pass into a single block, the whole block is allocated since
+        // that's what the descriptor range covers
+        void *data = nullptr;
+        dynamicOffsets[1] = uniformRing.allocate(sizeof(ObjectData) * maxObjectCount, &data);
+        auto objectData = static_cast<ObjectData*>(data);
+        for (const auto &object: objects)
+            *objectData++ = {object.transform->getWorldMatrix(), object.color, object.textureIndex, {}};
     }
 
-    auto getDescPool() -> vk::DescriptorPool& { return descPool; }
-    auto getDescSetLayout() const -> VkDescriptorSetLayout { return descSetLayout; }
+    auto getShaderCompiler() -> ShaderCompiler& { return shaderCompiler; }
+    auto getPipelineCache() -> vk::PipelineCache& { return pipelineCache; }
+    auto getDescAllocator() -> vk::DescriptorAllocator& { return descAllocator; }
     auto getDescSet() const -> VkDescriptorSet { return descSet; }
+    auto getTextureTable() const -> vk::TextureTable* { return textureTable.get(); } // null unless in bindless mode
+    auto getShaderDefines() const -> ShaderCompiler::Defines
+    {
+        return textureTable ? ShaderCompiler::Defines{{"BINDLESS", "1"}} : ShaderCompiler::Defines{};
+    }
+    auto getDynamicOffsets() const -> const std::array<uint32_t, 2>& { return dynamicOffsets; } // of set 0 for the current frame
 
 private:
-    vk::DescriptorPool descPool;
-    vk::Resource<VkDescriptorSetLayout> descSetLayout;
+    ShaderCompiler shaderCompiler;
+    vk::PipelineCache pipelineCache;
+    vk::DescriptorAllocator descAllocator;
+    VkDescriptorSetLayout descSetLayout;
     VkDescriptorSet descSet;
+    uptr<vk::TextureTable> textureTable;
 
     struct
     {
@@ -102,68 +156,164 @@ private:
         glm::mat4 view;
     } viewMatrices;
 
-    vk::Buffer viewMatricesBuffer;
+    // Matches ObjectData in ObjectData.glsl
+    struct ObjectData
+    {
+        glm::mat4 model;
+        glm::vec4 color;
+        uint32_t textureIndex;
+        uint32_t padding[3]; // std430 rounds the struct up to the alignment of its largest member
+    };
+
+    struct Object
+    {
+        const Transform *transform;
+        glm::vec4 color;
+        uint32_t textureIndex;
+    };
+
+    static const uint32_t maxObjectCount = 256;
+    static const uint32_t maxTextureCount = 4096;
+
+    std::vector<Object> objects;
+    vk::RingBuffer uniformRing;
+    std::array<uint32_t, 2> dynamicOffsets{{0, 0}};
 };
 
 class Offscreen
 {
 public:
-    Offscreen(const vk::Device &device, uint32_t canvasWidth, uint32_t canvasHeight)
-    {
-        colorAttachment = vk::Image(device, canvasWidth, canvasHeight, 1, 1,
-            VK_FORMAT_R8G8B8A8_UNORM,
-            0,
-            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-            VK_IMAGE_VIEW_TYPE_2D,
-            VK_IMAGE_ASPECT_COLOR_BIT);
-        depthAttachment = vk::Image(device, canvasWidth, canvasHeight, 1, 1,
-            device.getDepthFormat(),
-            0,
-            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-            VK_IMAGE_VIEW_TYPE_2D,
-            VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+    using DrawScene = std::function<void(VkCommandBuffer buf, const vk::RenderGraphPassContext &context)>;
+
+    // Frames go through a render graph. Scene color is exported for post-processing in the swapchain pass,
+    // or copied into a host-visible buffer of the frame slot with readback, depth exists only within the frame.
+    // The graph's barriers order consecutive frames using the same images.
+    Offscreen(const vk::Device &device, uint32_t canvasWidth, uint32_t canvasHeight, uint32_t frameCount,
+        vk::GpuProfiler &profiler, bool readback):
+        profiler(profiler),
+        width(canvasWidth),
+        height(canvasHeight)
+    {
+        profilerScope = profiler.addScope("offscreen");
 
-        renderPass = vk::RenderPass(device, vk::RenderPassConfig()
-            .withColorAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, {0, 1, 1, 0})
-            .withDepthAttachment(device.getDepthFormat(), true, {1, 0}));
+        graph = vk::RenderGraph(device);
+        colorImage = graph.addImage(canvasWidth, canvasHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+        const auto depthImage = graph.addImage(canvasWidth, canvasHeight, device.getDepthFormat(),
+            VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
+        if (readback)
+            graph.exportImage(colorImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        else
+        {
+            graph.exportImage(colorImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        }
 
-        frameBuffer = createFrameBuffer(device, colorAttachment.getView(),
-            depthAttachment.getView(), renderPass, canvasWidth, canvasHeight);
+        scenePass = graph.addPass(vk::RenderGraphPass()
+            .withColorOutput(colorImage, true, {0, 1, 1, 0})
+            .withDepthOutput(depthImage, true, {1, 0})
+            .withSecondaryCommandBuffers()
+            .withExecute([this](VkCommandBuffer buf, const vk::RenderGraphPassContext &context)
+            {
+                (*drawScene)(buf, context);
+            }));
+
+        graph.compile();
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
+        samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        colorSampler = vk::Resource<VkSampler>{device};
+        KL_VK_CHECK_RESULT(vkCreateSampler(device, &samplerInfo, nullptr, colorSampler.cleanRef()));
+
+        frames.resize(frameCount);
+        for (auto &frame: frames)
+        {
+            frame.semaphore = createSemaphore(device);
+            frame.commandBuffer = createCommandBuffer(device, device.getCommandPool());
+            if (readback)
+            {
+                frame.readback = vk::Buffer(device, canvasWidth * canvasHeight * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            }
+        }
+    }
 
-        semaphore = createSemaphore(device);
+    // Records the frame's command buffer, drawScene records the scene pass. The buffer is the first one submitted
+    // in the frame, so it starts the profiler's frame.
+    void record(uint32_t frameIndex, const DrawScene &drawScene)
+    {
+        const VkCommandBuffer buf = frames[frameIndex].commandBuffer;
+        vk::beginCommandBuffer(buf, true);
+        profiler.beginFrame(buf, frameIndex);
+        profiler.beginScope(buf, frameIndex, profilerScope);
+        this->drawScene = &drawScene;
+        graph.execute(buf);
+        profiler.endScope(buf, frameIndex, profilerScope);
+
+        // The export barrier has made the image ready for the copy
+        const auto &readback = frames[frameIndex].readback;
+        if (readback.getHandle())
+        {
+            VkBufferImageCopy region{};
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            region.imageExtent = {width, height, 1};
+            vkCmdCopyImageToBuffer(buf, graph.getImage(colorImage), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                readback.getHandle(), 1, &region);
+            vk::bufferBarrier(buf, readback.getHandle(), VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+        }
 
-        commandBuffer = createCommandBuffer(device, device.getCommandPool());
+        KL_VK_CHECK_RESULT(vkEndCommandBuffer(buf));
     }
 
-    auto getColorAttachment() -> vk::Image& { return colorAttachment; }
-    auto getRenderPass() -> vk::RenderPass& { return renderPass; }
-    auto getSemaphore() -> vk::Resource<VkSemaphore>& { return semaphore; }
-    auto getCommandBuffer() -> vk::Resource<VkCommandBuffer>& { return commandBuffer; }
-    auto getFrameBuffer() const -> VkFramebuffer { return frameBuffer; }
+    auto getColorView() const -> VkImageView { return graph.getImageView(colorImage); }
+    auto getColorSampler() const -> VkSampler { return colorSampler; }
+    auto getRenderPass() const -> VkRenderPass { return graph.getRenderPass(scenePass); }
+    auto getGraphStats() const -> vk::RenderGraphStats { return graph.getStats(); }
+    auto getSemaphore(uint32_t frameIndex) -> vk::Resource<VkSemaphore>& { return frames[frameIndex].semaphore; }
+    auto getCommandBuffer(uint32_t frameIndex) -> vk::Resource<VkCommandBuffer>& { return frames[frameIndex].commandBuffer; }
+    // RGBA8 rows of the frame's color with readback, valid once the frame's commands complete
+    auto getReadbackData(uint32_t frameIndex) const -> const void* { return frames[frameIndex].readback.getMappedData(); }
 
 private:
-    vk::Image colorAttachment;
-    vk::Image depthAttachment;
-    vk::Resource<VkFramebuffer> frameBuffer;
-    vk::RenderPass renderPass;
-    vk::Resource<VkSemaphore> semaphore;
-    vk::Resource<VkCommandBuffer> commandBuffer;
+    vk::RenderGraph graph;
+    uint32_t colorImage;
+    uint32_t scenePass;
+    vk::Resource<VkSampler> colorSampler;
+    const DrawScene *drawScene = nullptr;
+    vk::GpuProfiler &profiler;
+    uint32_t profilerScope;
+    uint32_t width;
+    uint32_t height;
+
+    struct Frame
+    {
+        vk::Resource<VkSemaphore> semaphore;
+        vk::Resource<VkCommandBuffer> commandBuffer;
+        vk::Buffer readback;
+    };
+
+    std::vector<Frame> frames;
 };
 
 class Mesh
 {
 public:
     Mesh(const vk::Device &device, VkRenderPass renderPass, Scene &scene):
-        globalDescSet(scene.getDescSet())
+        scene(scene)
     {
-        auto vsSrc = fs::readBytes("../../assets/shaders/Mesh.vert.spv");
-        auto fsSrc = fs::readBytes("../../assets/shaders/Mesh.frag.spv");
-        auto vs = createShader(device, vsSrc.data(), vsSrc.size());
-        auto fs = createShader(device, fsSrc.data(), fsSrc.size());
-
-        glm::mat4 modelMatrix{};
-        modelMatrixBuffer = vk::Buffer::createUniformHostVisible(device, sizeof(glm::mat4));
-        modelMatrixBuffer.update(&modelMatrix);
+        auto vsSrc = scene.getShaderCompiler().compile("../../assets/shaders/Mesh.vert", scene.getShaderDefines());
+        auto fsSrc = scene.getShaderCompiler().compile("../../assets/shaders/Mesh.frag", scene.getShaderDefines());
+        const auto vs = scene.getPipelineCache().getShader(vsSrc);
+        const auto fs = scene.getPipelineCache().getShader(fsSrc);
 
         auto data = MeshData::load("../../assets/meshes/Teapot.obj");
 
@@ -173,103 +323,114 @@ public:
             VK_BUFFER_USAGE_INDEX_BUFFER_BIT, data.getIndexData().data());
         indexCount = data.getIndexData().size();
 
-        descSetLayout = vk::DescriptorSetLayoutBuilder(device)
-            .withBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
-            .withBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
-            .build();
+	    const auto textureData = ImageData::load2D("../../assets/textures/Cobblestone.png");
+        texture = vk::Image::create2D(device, textureData);
+
+        const auto reflection = vk::ShaderReflection(vsSrc).merge(vk::ShaderReflection(fsSrc))
+            .withDynamicBuffers(0);
+        auto setLayouts = scene.getPipelineCache().getDescriptorSetLayouts(reflection);
+
+        if (const auto textureTable = scene.getTextureTable())
+        {
+            setLayouts[1] = textureTable->getLayout();
+            descSet = textureTable->getSet();
+            objectIndex = scene.addObject(transform, glm::vec4{1.0f},
+                textureTable->add(texture.getView(), texture.getSampler(), texture.getLayout()));
+        }
+        else
+        {
+            descSet = scene.getDescAllocator().getSet(setLayouts[1], vk::DescriptorBindings()
+                .withTexture(0, texture.getView(), texture.getSampler(), texture.getLayout()));
+            objectIndex = scene.addObject(transform);
+        }
 
-        pipeline = vk::Pipeline(device, renderPass, vk::PipelineConfig(vs, fs)
-            .withDescriptorSetLayout(scene.getDescSetLayout())
-            .withDescriptorSetLayout(descSetLayout)
+        pipeline = scene.getPipelineCache().getPipelineAsync(renderPass, vk::PipelineConfig(vs, fs)
+            .withDescriptorSetLayouts(setLayouts)
+            .withPushConstants(reflection)
             .withFrontFace(VK_FRONT_FACE_CLOCKWISE)
             .withCullMode(VK_CULL_MODE_NONE)
             .withTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
             .withVertexFormat(data.getFormat()));
-
-        descSet = scene.getDescPool().allocateSet(descSetLayout);
-
-	    const auto textureData = ImageData::load2D("../../assets/textures/Cobblestone.png");
-        texture = vk::Image::create2D(device, textureData);
-
-        vk::DescriptorSetUpdater(device)
-            .forUniformBuffer(0, descSet, modelMatrixBuffer, 0, sizeof(modelMatrix))
-            .forTexture(1, descSet, texture.getView(), texture.getSampler(), texture.getLayout())
-            .updateSets();
     }
 
     void render(VkCommandBuffer buf)
     {
+        const auto &pipeline = this->pipeline.get();
         VkBuffer vertexBuffer = this->vertexBuffer;
         VkDeviceSize vertexBufferOffset = 0;
-        std::vector<VkDescriptorSet> descSets = {globalDescSet, descSet};
-        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getLayout(), 0, 2, descSets.data(), 0, nullptr);
+        const auto &dynamicOffsets = scene.getDynamicOffsets();
+        std::vector<VkDescriptorSet> descSets = {scene.getDescSet(), descSet};
+        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getHandle());
+        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getLayout(), 0, 2, descSets.data(),
+            dynamicOffsets.size(), dynamicOffsets.data());
+        vk::pushConstants(buf, pipeline->getLayout(), VK_SHADER_STAGE_VERTEX_BIT, objectIndex);
         vkCmdBindVertexBuffers(buf, 0, 1, &vertexBuffer, &vertexBufferOffset);
         vkCmdBindIndexBuffer(buf, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
         vkCmdDrawIndexed(buf, indexCount, 1, 0, 0, 0);
     }
 
 private:
-    vk::Resource<VkDescriptorSetLayout> descSetLayout;
-    vk::Pipeline pipeline;
+    std::shared_future<sptr<vk::Pipeline>> pipeline;
     vk::Image texture;
-    vk::Buffer modelMatrixBuffer;
+    Transform transform;
+    uint32_t objectIndex;
     vk::Buffer vertexBuffer;
     vk::Buffer indexBuffer;
     uint32_t indexCount;
     VkDescriptorSet descSet;
-    VkDescriptorSet globalDescSet;
+    const Scene &scene;
 };
 
 class PostProcessor
 {
 public:
-    PostProcessor(const vk::Device &device, Offscreen &offscreen, Scene &scene)
+    enum Feature
     {
-        auto vsSrc = fs::readBytes("../../assets/shaders/PostProcess.vert.spv");
-        auto fsSrc = fs::readBytes("../../assets/shaders/PostProcess.frag.spv");
-	    const auto vs = createShader(device, vsSrc.data(), vsSrc.size());
-        const auto fs = createShader(device, fsSrc.data(), fsSrc.size());
+        Grayscale = 1 << 0,
+        Vignette = 1 << 1
+    };
+
+    PostProcessor(const vk::Device &device, Offscreen &offscreen, Scene &scene, uint32_t features)
+    {
+        auto vsSrc = scene.getShaderCompiler().compile("../../assets/shaders/PostProcess.vert");
+        auto fsSrc = scene.getShaderCompiler().compile("../../assets/shaders/PostProcess.frag");
+	    const auto vs = scene.getPipelineCache().getShader(vsSrc);
+        const auto fs = scene.getPipelineCache().getShader(fsSrc);
 
         vertexBuffer = vk::Buffer::createDeviceLocal(device, sizeof(float) * quadVertexData.size(),
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, quadVertexData.data());
 
-        descSetLayout = vk::DescriptorSetLayoutBuilder(device)
-            .withBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
-            .build();
+        const auto reflection = vk::ShaderReflection(vsSrc).merge(vk::ShaderReflection(fsSrc));
+        const auto setLayouts = scene.getPipelineCache().getDescriptorSetLayouts(reflection);
 
-        pipeline = vk::Pipeline(device, offscreen.getRenderPass(), vk::PipelineConfig(vs, fs)
+        permutations = vk::PipelinePermutations(scene.getPipelineCache(), offscreen.getRenderPass(), vk::PipelineConfig(vs, fs)
             .withDepthTest(false, false)
-            .withDescriptorSetLayout(descSetLayout)
+            .withDescriptorSetLayouts(setLayouts)
             .withFrontFace(VK_FRONT_FACE_CLOCKWISE)
             .withCullMode(VK_CULL_MODE_NONE)
             .withTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
-            .withVertexFormat(VertexFormat{{3, 2}}));
+            .withVertexInput(reflection), VK_SHADER_STAGE_FRAGMENT_BIT, 2);
+        pipeline = permutations.get(features);
 
-        descSet = scene.getDescPool().allocateSet(descSetLayout);
-
-        auto &colorAttachment = offscreen.getColorAttachment();
-        vk::DescriptorSetUpdater(device)
-            .forTexture(0, descSet, colorAttachment.getView(), colorAttachment.getSampler(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-            .updateSets();
+        descSet = scene.getDescAllocator().getSet(setLayouts[0], vk::DescriptorBindings()
+            .withTexture(0, offscreen.getColorView(), offscreen.getColorSampler(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
     }
 
     void render(VkCommandBuffer buf)
     {
+        const auto &pipeline = this->pipeline.get();
         std::vector<VkBuffer> vertexBuffers = {vertexBuffer};
         std::vector<VkDeviceSize> vertexBufferOffsets = {0};
         std::vector<VkDescriptorSet> descSets = {descSet};
-        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getLayout(), 0, 1, descSets.data(), 0, nullptr);
+        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getHandle());
+        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getLayout(), 0, 1, descSets.data(), 0, nullptr);
         vkCmdBindVertexBuffers(buf, 0, 1, vertexBuffers.data(), vertexBufferOffsets.data());
         vkCmdDraw(buf, 6, 1, 0, 0);
     }
 
 private:
-    vk::Resource<VkDescriptorSetLayout> descSetLayout;
-    vk::Pipeline pipeline;
-    vk::Image texture;
-    vk::Buffer modelMatrixBuffer;
+    vk::PipelinePermutations permutations;
+    std::shared_future<sptr<vk::Pipeline>> pipeline;
     vk::Buffer vertexBuffer;
     VkDescriptorSet descSet;
 };
@@ -278,96 +439,88 @@ class Skybox
 {
 public:
     Skybox(const vk::Device &device, Offscreen &offscreen, Scene &scene):
-        globalDescSet(scene.getDescSet())
+        scene(scene)
     {
-        auto vsSrc = fs::readBytes("../../assets/shaders/Skybox.vert.spv");
-        auto fsSrc = fs::readBytes("../../assets/shaders/Skybox.frag.spv");
-        const auto vs = createShader(device, vsSrc.data(), vsSrc.size());
-        const auto fs = createShader(device, fsSrc.data(), fsSrc.size());
-
-        glm::mat4 modelMatrix{};
-        modelMatrixBuffer = vk::Buffer::createUniformHostVisible(device, sizeof(glm::mat4));
-        modelMatrixBuffer.update(&modelMatrix);
+        auto vsSrc = scene.getShaderCompiler().compile("../../assets/shaders/Skybox.vert");
+        auto fsSrc = scene.getShaderCompiler().compile("../../assets/shaders/Skybox.frag");
+        const auto vs = scene.getPipelineCache().getShader(vsSrc);
+        const auto fs = scene.getPipelineCache().getShader(fsSrc);
 
         vertexBuffer = vk::Buffer::createDeviceLocal(device, sizeof(float) * quadVertexData.size(),
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, quadVertexData.data());
 
-        descSetLayout = vk::DescriptorSetLayoutBuilder(device)
-            .withBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
-            .withBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
-            .build();
+        const auto reflection = vk::ShaderReflection(vsSrc).merge(vk::ShaderReflection(fsSrc))
+            .withDynamicBuffers(0);
+        const auto setLayouts = scene.getPipelineCache().getDescriptorSetLayouts(reflection);
 
-        pipeline = vk::Pipeline(device, offscreen.getRenderPass(), vk::PipelineConfig(vs, fs)
+        // The shader reads only positions from the shared quad vertex data
+        pipeline = scene.getPipelineCache().getPipelineAsync(offscreen.getRenderPass(), vk::PipelineConfig(vs, fs)
             .withDepthTest(false, false)
-            .withDescriptorSetLayout(scene.getDescSetLayout())
-            .withDescriptorSetLayout(descSetLayout)
+            .withDescriptorSetLayouts(setLayouts)
+            .withPushConstants(reflection)
             .withFrontFace(VK_FRONT_FACE_CLOCKWISE)
             .withCullMode(VK_CULL_MODE_NONE)
             .withTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
-            .withVertexBinding(0, sizeof(float) * 5, VK_VERTEX_INPUT_RATE_VERTEX)
-            .withVertexAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0)
-            .withVertexAttribute(1, 0, VK_FORMAT_R32G32_SFLOAT, sizeof(float) * 3));
+            .withVertexInput(reflection, sizeof(float) * 5));
 
-        descSet = scene.getDescPool().allocateSet(descSetLayout);
+        objectIndex = scene.addObject(transform);
 
         const auto data = ImageData::loadCube("../../assets/textures/Cubemap_space.ktx");
         texture = vk::Image::createCube(device, data);
 
-        vk::DescriptorSetUpdater(device)
-            .forUniformBuffer(0, descSet, modelMatrixBuffer, 0, sizeof(modelMatrix))
-            .forTexture(1, descSet, texture.getView(), texture.getSampler(), texture.getLayout())
-            .updateSets();
+        descSet = scene.getDescAllocator().getSet(setLayouts[1], vk::DescriptorBindings()
+            .withTexture(0, texture.getView(), texture.getSampler(), texture.getLayout()));
     }
 
     void render(VkCommandBuffer buf)
     {
+        const auto &pipeline = this->pipeline.get();
         std::vector<VkBuffer> vertexBuffers = {vertexBuffer};
         std::vector<VkDeviceSize> vertexBufferOffsets = {0};
-        std::vector<VkDescriptorSet> descSets = {globalDescSet, descSet};
-        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getLayout(), 0, 2, descSets.data(), 0, nullptr);
+        const auto &dynamicOffsets = scene.getDynamicOffsets();
+        std::vector<VkDescriptorSet> descSets = {scene.getDescSet(), descSet};
+        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getHandle());
+        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getLayout(), 0, 2, descSets.data(),
+            dynamicOffsets.size(), dynamicOffsets.data());
+        vk::pushConstants(buf, pipeline->getLayout(), VK_SHADER_STAGE_VERTEX_BIT, objectIndex);
         vkCmdBindVertexBuffers(buf, 0, 1, vertexBuffers.data(), vertexBufferOffsets.data());
         vkCmdDraw(buf, 6, 1, 0, 0);
     }
 
+    // What the commands of render() depend on
+    void appendBundleKey(vk::CommandBundleKey &key) const
+    {
+        const auto &dynamicOffsets = scene.getDynamicOffsets();
+        key.withPipeline(pipeline.get()->getHandle())
+            .withDescriptorSets({scene.getDescSet(), descSet}, {dynamicOffsets.begin(), dynamicOffsets.end()})
+            .withVersion(transform.getVersion());
+    }
+
 private:
-    vk::Resource<VkDescriptorSetLayout> descSetLayout;
-    vk::Pipeline pipeline;
+    std::shared_future<sptr<vk::Pipeline>> pipeline;
     vk::Image texture;
-    vk::Buffer modelMatrixBuffer;
+    Transform transform;
+    uint32_t objectIndex;
     vk::Buffer vertexBuffer;
     VkDescriptorSet descSet;
-    VkDescriptorSet globalDescSet;
+    const Scene &scene;
 };
 
 class Axes
 {
 public:
     Axes(const vk::Device &device, Offscreen &offscreen, Scene &scene):
-        globalDescSet(scene.getDescSet())
+        scene(scene)
     {
-        Transform t;
-        t.setLocalPosition({3, 0, 3});
-	    auto modelMatrix = t.getWorldMatrix();
-        modelMatrixBuffer = vk::Buffer::createUniformHostVisible(device, sizeof(glm::mat4));
-        modelMatrixBuffer.update(&modelMatrix);
-
-        glm::vec3 red{1.0f, 0, 0};
-        redColorUniformBuffer = vk::Buffer::createUniformHostVisible(device, sizeof(glm::vec3));
-        redColorUniformBuffer.update(&red);
-
-        glm::vec3 green{0, 1.0f, 0};
-        greenColorUniformBuffer = vk::Buffer::createUniformHostVisible(device, sizeof(glm::vec3));
-        greenColorUniformBuffer.update(&green);
+        transform.setLocalPosition({3, 0, 3});
+        xAxisObjectIndex = scene.addObject(transform, {1.0f, 0, 0, 1.0f});
+        yAxisObjectIndex = scene.addObject(transform, {0, 1.0f, 0, 1.0f});
+        zAxisObjectIndex = scene.addObject(transform, {0, 0, 1.0f, 1.0f});
 
-        glm::vec3 blue{0, 0, 1.0f};
-        blueColorUniformBuffer = vk::Buffer::createUniformHostVisible(device, sizeof(glm::vec3));
-        blueColorUniformBuffer.update(&blue);
-
-        auto vsSrc = fs::readBytes("../../assets/shaders/Axis.vert.spv");
-        auto fsSrc = fs::readBytes("../../assets/shaders/Axis.frag.spv");
-        const auto vs = createShader(device, vsSrc.data(), vsSrc.size());
-        const auto fs = createShader(device, fsSrc.data(), fsSrc.size());
+        auto vsSrc = scene.getShaderCompiler().compile("../../assets/shaders/Axis.vert");
+        auto fsSrc = scene.getShaderCompiler().compile("../../assets/shaders/Axis.frag");
+        const auto vs = scene.getPipelineCache().getShader(vsSrc);
+        const auto fs = scene.getPipelineCache().getShader(fsSrc);
 
         xAxisVertexBuffer = vk::Buffer::createDeviceLocal(device, sizeof(float) * xAxisVertexData.size(),
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, xAxisVertexData.data());
@@ -376,92 +529,121 @@ public:
         zAxisVertexBuffer = vk::Buffer::createDeviceLocal(device, sizeof(float) * zAxisVertexData.size(),
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, zAxisVertexData.data());
 
-        descSetLayout = vk::DescriptorSetLayoutBuilder(device)
-            .withBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
-            .withBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
-            .build();
+        const auto reflection = vk::ShaderReflection(vsSrc).merge(vk::ShaderReflection(fsSrc))
+            .withDynamicBuffers(0);
 
-        pipeline = vk::Pipeline(device, offscreen.getRenderPass(), vk::PipelineConfig(vs, fs)
-            .withDescriptorSetLayout(scene.getDescSetLayout())
-            .withDescriptorSetLayout(descSetLayout)
+        pipeline = scene.getPipelineCache().getPipelineAsync(offscreen.getRenderPass(), vk::PipelineConfig(vs, fs)
+            .withDescriptorSetLayouts(scene.getPipelineCache().getDescriptorSetLayouts(reflection))
+            .withPushConstants(reflection)
             .withFrontFace(VK_FRONT_FACE_CLOCKWISE)
             .withCullMode(VK_CULL_MODE_NONE)
             .withTopology(VK_PRIMITIVE_TOPOLOGY_LINE_LIST)
-            .withVertexBinding(0, sizeof(float) * 3, VK_VERTEX_INPUT_RATE_VERTEX)
-            .withVertexAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0));
-
-        redDescSet = scene.getDescPool().allocateSet(descSetLayout);
-        greenDescSet = scene.getDescPool().allocateSet(descSetLayout);
-        blueDescSet = scene.getDescPool().allocateSet(descSetLayout);
-
-        vk::DescriptorSetUpdater(device)
-            .forUniformBuffer(0, redDescSet, modelMatrixBuffer, 0, sizeof(modelMatrix))
-            .forUniformBuffer(1, redDescSet, redColorUniformBuffer, 0, sizeof(glm::vec3))
-            .updateSets();
-
-        vk::DescriptorSetUpdater(device)
-            .forUniformBuffer(0, greenDescSet, modelMatrixBuffer, 0, sizeof(modelMatrix))
-            .forUniformBuffer(1, greenDescSet, greenColorUniformBuffer, 0, sizeof(glm::vec3))
-            .updateSets();
-
-        vk::DescriptorSetUpdater(device)
-            .forUniformBuffer(0, blueDescSet, modelMatrixBuffer, 0, sizeof(modelMatrix))
-            .forUniformBuffer(1, blueDescSet, blueColorUniformBuffer, 0, sizeof(glm::vec3))
-            .updateSets();
+            .withVertexInput(reflection));
     }
 
     void render(VkCommandBuffer buf)
     {
-        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        const auto &pipeline = this->pipeline.get();
+        const auto stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        const auto globalDescSet = scene.getDescSet();
+        const auto &dynamicOffsets = scene.getDynamicOffsets();
+        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getHandle());
+        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getLayout(), 0, 1, &globalDescSet,
+            dynamicOffsets.size(), dynamicOffsets.data());
 
-        std::vector<VkDescriptorSet> descSets = {globalDescSet, redDescSet};
-            
         std::vector<VkDeviceSize> vertexBufferOffsets = {0};
 
         // TODO bind all at once
         std::vector<VkBuffer> vertexBuffers = {xAxisVertexBuffer};
-        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getLayout(), 0, 2, descSets.data(), 0, nullptr);
+        vk::pushConstants(buf, pipeline->getLayout(), stages, xAxisObjectIndex);
         vkCmdBindVertexBuffers(buf, 0, 1, vertexBuffers.data(), vertexBufferOffsets.data());
         vkCmdDraw(buf, 4, 1, 0, 0);
 
         vertexBuffers[0] = yAxisVertexBuffer;
-        descSets[1] = greenDescSet;
-        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getLayout(), 0, 2, descSets.data(), 0, nullptr);
+        vk::pushConstants(buf, pipeline->getLayout(), stages, yAxisObjectIndex);
         vkCmdBindVertexBuffers(buf, 0, 1, vertexBuffers.data(), vertexBufferOffsets.data());
         vkCmdDraw(buf, 4, 1, 0, 0);
 
         vertexBuffers[0] = zAxisVertexBuffer;
-        descSets[1] = blueDescSet;
-        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getLayout(), 0, 2, descSets.data(), 0, nullptr);
+        vk::pushConstants(buf, pipeline->getLayout(), stages, zAxisObjectIndex);
         vkCmdBindVertexBuffers(buf, 0, 1, vertexBuffers.data(), vertexBufferOffsets.data());
         vkCmdDraw(buf, 4, 1, 0, 0);
     }
 
+    // What the commands of render() depend on
+    void appendBundleKey(vk::CommandBundleKey &key) const
+    {
+        const auto &dynamicOffsets = scene.getDynamicOffsets();
+        key.withPipeline(pipeline.get()->getHandle())
+            .withDescriptorSets({scene.getDescSet()}, {dynamicOffsets.begin(), dynamicOffsets.end()})
+            .withVersion(transform.getVersion());
+    }
+
 private:
-    vk::Resource<VkDescriptorSetLayout> descSetLayout;
-    vk::Pipeline pipeline;
-    vk::Buffer redColorUniformBuffer;
-    vk::Buffer greenColorUniformBuffer;
-    vk::Buffer blueColorUniformBuffer;
+    std::shared_future<sptr<vk::Pipeline>> pipeline;
+    Transform transform;
+    uint32_t xAxisObjectIndex;
+    uint32_t yAxisObjectIndex;
+    uint32_t zAxisObjectIndex;
     vk::Buffer xAxisVertexBuffer;
     vk::Buffer yAxisVertexBuffer;
     vk::Buffer zAxisVertexBuffer;
-    vk::Buffer modelMatrixBuffer;
-    VkDescriptorSet redDescSet;
-    VkDescriptorSet greenDescSet;
-    VkDescriptorSet blueDescSet;
-    VkDescriptorSet globalDescSet;
+    const Scene &scene;
 };
 
 class Label
 {
 public:
     Label(const vk::Device &device, const std::string &text, VkRenderPass renderPass, Scene &scene):
-        globalDescSet(scene.getDescSet())
+        device(device),
+        scene(scene)
     {
         const auto fontData = fs::readBytes("../../assets/Aller.ttf");
         font = Font::createTrueType(device, fontData, 100, 2048, 2048, ' ', '~' - ' ', 2, 2);
 
+        setText(text);
+
+        auto vsSrc = scene.getShaderCompiler().compile("../../assets/shaders/Font.vert", scene.getShaderDefines());
+        auto fsSrc = scene.getShaderCompiler().compile("../../assets/shaders/Font.frag", scene.getShaderDefines());
+        const auto vs = scene.getPipelineCache().getShader(vsSrc);
+        const auto fs = scene.getPipelineCache().getShader(fsSrc);
+
+        transform.setLocalScale({0.05f, 0.05f, 0.05f});
+        transform.setLocalPosition({0, 0, 4});
+
+        const auto reflection = vk::ShaderReflection(vsSrc).merge(vk::ShaderReflection(fsSrc))
+            .withDynamicBuffers(0);
+        auto setLayouts = scene.getPipelineCache().getDescriptorSetLayouts(reflection);
+
+        const auto &atlas = font.getAtlas();
+        if (const auto textureTable = scene.getTextureTable())
+        {
+            setLayouts[1] = textureTable->getLayout();
+            descSet = textureTable->getSet();
+            objectIndex = scene.addObject(transform, glm::vec4{1.0f},
+                textureTable->add(atlas.getView(), atlas.getSampler(), atlas.getLayout()));
+        }
+        else
+        {
+            descSet = scene.getDescAllocator().getSet(setLayouts[1], vk::DescriptorBindings()
+                .withTexture(0, atlas.getView(), atlas.getSampler(), atlas.getLayout()));
+            objectIndex = scene.addObject(transform);
+        }
+
+        pipeline = scene.getPipelineCache().getPipelineAsync(renderPass, vk::PipelineConfig(vs, fs)
+            .withDescriptorSetLayouts(setLayouts)
+            .withPushConstants(reflection)
+            .withFrontFace(VK_FRONT_FACE_CLOCKWISE)
+            .withCullMode(VK_CULL_MODE_NONE)
+            .withBlend(true, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE,
+                VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE)
+            .withTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
+            .withVertexInput(reflection));
+    }
+
+    // Replaces the buffers, the old ones may still be used by frames in flight and go to the deletion queue
+    void setText(const std::string &text)
+    {
         std::vector<float> vertexData;
         std::vector<uint32_t> indexData;
 
@@ -507,56 +689,24 @@ public:
             lastIndex += 4;
         }
 
-        auto vsSrc = fs::readBytes("../../assets/shaders/Font.vert.spv");
-        auto fsSrc = fs::readBytes("../../assets/shaders/Font.frag.spv");
-        const auto vs = createShader(device, vsSrc.data(), vsSrc.size());
-        const auto fs = createShader(device, fsSrc.data(), fsSrc.size());
-
-        Transform t;
-        t.setLocalScale({0.05f, 0.05f, 0.05f});
-        t.setLocalPosition({0, 0, 4});
-	    auto modelMatrix = t.getWorldMatrix();
-        modelMatrixBuffer = vk::Buffer::createUniformHostVisible(device, sizeof(glm::mat4));
-        modelMatrixBuffer.update(&modelMatrix);
-
         vertexBuffer = vk::Buffer::createDeviceLocal(device, sizeof(float) * vertexData.size(),
             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexData.data());
         indexBuffer = vk::Buffer::createDeviceLocal(device, sizeof(uint32_t) * indexData.size(),
             VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexData.data());
         indexCount = indexData.size();
-
-        descSetLayout = vk::DescriptorSetLayoutBuilder(device)
-            .withBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
-            .withBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
-            .build();
-
-        const auto vf = VertexFormat({3, 2});
-
-        pipeline = vk::Pipeline(device, renderPass, vk::PipelineConfig(vs, fs)
-            .withDescriptorSetLayout(scene.getDescSetLayout())
-            .withDescriptorSetLayout(descSetLayout)
-            .withFrontFace(VK_FRONT_FACE_CLOCKWISE)
-            .withCullMode(VK_CULL_MODE_NONE)
-            .withBlend(true, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE,
-                VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE)
-            .withTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST)
-            .withVertexFormat(vf));
-
-        descSet = scene.getDescPool().allocateSet(descSetLayout);
-
-        vk::DescriptorSetUpdater(device)
-            .forUniformBuffer(0, descSet, modelMatrixBuffer, 0, sizeof(modelMatrix))
-            .forTexture(1, descSet, font.getAtlas().getView(), font.getAtlas().getSampler(), font.getAtlas().getLayout())
-            .updateSets();
     }
 
     void render(VkCommandBuffer buf)
     {
+        const auto &pipeline = this->pipeline.get();
         VkBuffer vertexBuffer = this->vertexBuffer;
         VkDeviceSize vertexBufferOffset = 0;
-        std::vector<VkDescriptorSet> descSets = {globalDescSet, descSet};
-        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.getLayout(), 0, 2, descSets.data(), 0, nullptr);
+        const auto &dynamicOffsets = scene.getDynamicOffsets();
+        std::vector<VkDescriptorSet> descSets = {scene.getDescSet(), descSet};
+        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getHandle());
+        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->getLayout(), 0, 2, descSets.data(),
+            dynamicOffsets.size(), dynamicOffsets.data());
+        vk::pushConstants(buf, pipeline->getLayout(), VK_SHADER_STAGE_VERTEX_BIT, objectIndex);
         vkCmdBindVertexBuffers(buf, 0, 1, &vertexBuffer, &vertexBufferOffset);
         vkCmdBindIndexBuffer(buf, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
         vkCmdDrawIndexed(buf, indexCount, 1, 0, 0, 0);
@@ -564,100 +714,677 @@ public:
 
 private:
     Font font;
-    vk::Resource<VkDescriptorSetLayout> descSetLayout;
-    vk::Pipeline pipeline;
-    vk::Image texture;
-    vk::Buffer modelMatrixBuffer;
+    std::shared_future<sptr<vk::Pipeline>> pipeline;
+    Transform transform;
+    uint32_t objectIndex;
     vk::Buffer vertexBuffer;
     vk::Buffer indexBuffer;
     uint32_t indexCount;
     VkDescriptorSet descSet;
-    VkDescriptorSet globalDescSet;
+    const vk::Device &device;
+    const Scene &scene;
 };
 
-int main()
+// Computes y = a * x + y on the GPU and checks the result on the CPU. Uses only core compute functionality,
+// so it can be run on a software implementation as well. The same work can be recorded for frame slots, to be
+// submitted with each frame.
+class ComputeSample
+{
+public:
+    ComputeSample(const vk::Device &device, ShaderCompiler &shaderCompiler, uint32_t frameCount = 0):
+        device(device)
+    {
+        const auto src = shaderCompiler.compile("../../assets/shaders/Saxpy.comp");
+        const auto reflection = vk::ShaderReflection(src);
+        shader = vk::createShader(device, src);
+        localSize = reflection.getLocalSize()[0];
+
+        setLayout = reflection.getSetLayoutBuilder(device, 0).build();
+
+        pipeline = vk::ComputePipeline(device, vk::ComputePipelineConfig(shader)
+            .withDescriptorSetLayout(setLayout)
+            .withPushConstants(reflection));
+
+        descPool = vk::DescriptorPool(device, 1 + frameCount, vk::DescriptorPoolConfig()
+            .forDescriptors(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * (1 + frameCount)));
+        descSet = descPool.allocateSet(setLayout);
+    }
+
+    // Each slot gets buffers that only the compute queue touches, so frames need neither queue family ownership
+    // transfers nor host access. Command buffers are reused, the slot's previous frame must be complete.
+    void recordFrames(uint32_t frameCount, uint32_t count, float a)
+    {
+        frameCmdPool = vk::createCommandPool(device, device.getComputeQueueIndex(), 0);
+
+        const auto size = sizeof(float) * count;
+        const auto usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        const Params params{count, a};
+
+        frames.resize(frameCount);
+        for (auto &frame: frames)
+        {
+            frame.x = vk::Buffer(device, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.y = vk::Buffer(device, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            frame.descSet = descPool.allocateSet(setLayout);
+            vk::DescriptorSetUpdater(device)
+                .forStorageBuffer(0, frame.descSet, frame.x, 0, size)
+                .forStorageBuffer(1, frame.descSet, frame.y, 0, size)
+                .updateSets();
+
+            frame.cmdBuf = vk::createCommandBuffer(device, frameCmdPool);
+            vk::beginCommandBuffer(frame.cmdBuf, false);
+
+            // 1.0f
+            vkCmdFillBuffer(frame.cmdBuf, frame.x, 0, VK_WHOLE_SIZE, 0x3f800000);
+            vkCmdFillBuffer(frame.cmdBuf, frame.y, 0, VK_WHOLE_SIZE, 0x3f800000);
+            for (const auto buffer: {frame.x.getHandle(), frame.y.getHandle()})
+            {
+                vk::bufferBarrier(frame.cmdBuf, buffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            }
+
+            vk::pushConstants(frame.cmdBuf, pipeline.getLayout(), VK_SHADER_STAGE_COMPUTE_BIT, params);
+            pipeline.dispatch(frame.cmdBuf, {frame.descSet}, vk::getGroupCount(count, localSize));
+
+            KL_VK_CHECK_RESULT(vkEndCommandBuffer(frame.cmdBuf));
+        }
+    }
+
+    // For the compute queue
+    auto getFrameCommandBuffer(uint32_t frameIndex) const -> VkCommandBuffer { return frames[frameIndex].cmdBuf; }
+
+    bool run(uint32_t count, float a)
+    {
+        std::vector<float> x(count), y(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            x[i] = i * 0.5f;
+            y[i] = static_cast<float>(count - i);
+        }
+
+        const auto size = sizeof(float) * count;
+        const auto memFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        auto xBuffer = vk::Buffer(device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, memFlags);
+        auto yBuffer = vk::Buffer(device, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, memFlags);
+        xBuffer.update(x.data());
+        yBuffer.update(y.data());
+
+        vk::DescriptorSetUpdater(device)
+            .forStorageBuffer(0, descSet, xBuffer, 0, size)
+            .forStorageBuffer(1, descSet, yBuffer, 0, size)
+            .updateSets();
+
+        const Params params{count, a};
+
+        // Runs on the async compute queue where there is one
+        auto cmdPool = vk::createCommandPool(device, device.getComputeQueueIndex(), 0);
+        auto cmdBuf = vk::createCommandBuffer(device, cmdPool);
+        vk::beginCommandBuffer(cmdBuf, true);
+
+        // Host writes before the submission are visible to the device without a barrier
+        vk::pushConstants(cmdBuf, pipeline.getLayout(), VK_SHADER_STAGE_COMPUTE_BIT, params);
+        pipeline.dispatch(cmdBuf, {descSet}, vk::getGroupCount(count, localSize));
+        vk::bufferBarrier(cmdBuf, yBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+
+        KL_VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuf));
+
+        vk::queueSubmit(device.getComputeQueue(), 0, nullptr, 0, nullptr, 1, &cmdBuf);
+        KL_VK_CHECK_RESULT(vkQueueWaitIdle(device.getComputeQueue()));
+
+        std::vector<float> result(count);
+        yBuffer.read(result.data());
+
+        uint32_t mismatches = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            // The device may or may not fuse the multiply-add
+            const auto expected = a * x[i] + y[i];
+            if (std::abs(result[i] - expected) > 1e-5f * (std::max)(1.0f, std::abs(expected)))
+                mismatches++;
+        }
+
+        std::cout << "Compute sample: " << count << " items in groups of " << localSize << ", "
+            << mismatches << " mismatches" << std::endl;
+
+        return mismatches == 0;
+    }
+
+private:
+    // Matches Params in Saxpy.comp
+    struct Params
+    {
+        uint32_t count;
+        float a;
+    };
+
+    struct Frame
+    {
+        vk::Buffer x;
+        vk::Buffer y;
+        VkDescriptorSet descSet;
+        vk::Resource<VkCommandBuffer> cmdBuf;
+    };
+
+    const vk::Device &device;
+    vk::Resource<VkShaderModule> shader;
+    vk::Resource<VkDescriptorSetLayout> setLayout;
+    vk::ComputePipeline pipeline;
+    vk::DescriptorPool descPool;
+    VkDescriptorSet descSet;
+    uint32_t localSize;
+    vk::Resource<VkCommandPool> frameCmdPool;
+    std::vector<Frame> frames;
+};
+
+// Rewrites every descriptor of many sets per iteration, as when per-object descriptors change each frame,
+// once through DescriptorSetUpdater and once through DescriptorUpdateTemplate
+class DescriptorUpdateBenchmark
+{
+public:
+    explicit DescriptorUpdateBenchmark(const vk::Device &device):
+        device(device)
+    {
+        setLayout = vk::DescriptorSetLayoutBuilder(device)
+            .withBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
+            .withBinding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
+            .withBinding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ALL_GRAPHICS)
+            .build();
+
+        descPool = vk::DescriptorPool(device, setCount, vk::DescriptorPoolConfig()
+            .forDescriptors(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setCount * 2)
+            .forDescriptors(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, setCount));
+        for (auto &set: sets)
+            set = descPool.allocateSet(setLayout);
+
+        buffer = vk::Buffer(device, setCount * blockSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        updateTemplate = vk::DescriptorUpdateTemplate(device, setLayout, vk::DescriptorUpdateTemplateConfig()
+            .withEntry(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(SetData, first))
+            .withEntry(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, offsetof(SetData, second))
+            .withEntry(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, offsetof(SetData, objects)));
+    }
+
+    void run(uint32_t iterations)
+    {
+        const auto updaterTime = measure(iterations, [&](uint32_t iteration)
+        {
+            vk::DescriptorSetUpdater updater(device);
+            for (uint32_t i = 0; i < setCount; i++)
+            {
+                const auto offset = getOffset(i, iteration);
+                updater
+                    .forUniformBuffer(0, sets[i], buffer, offset, 256)
+                    .forUniformBuffer(1, sets[i], buffer, offset + 256, 256)
+                    .forStorageBuffer(2, sets[i], buffer, offset + 512, 512);
+            }
+            updater.updateSets();
+        });
+
+        const auto templateTime = measure(iterations, [&](uint32_t iteration)
+        {
+            for (uint32_t i = 0; i < setCount; i++)
+            {
+                const auto offset = getOffset(i, iteration);
+                const SetData data{{buffer, offset, 256}, {buffer, offset + 256, 256}, {buffer, offset + 512, 512}};
+                updateTemplate.update(sets[i], &data);
+            }
+        });
+
+        const auto updateCount = static_cast<double>(iterations) * setCount;
+        std::cout << "Descriptor updates: " << setCount << " sets x " << iterations << " iterations, "
+            << "DescriptorSetUpdater " << updateCount / updaterTime << " sets/ms, "
+            << "update template (" << (updateTemplate.isNative() ? "native" : "fallback") << ") "
+            << updateCount / templateTime << " sets/ms" << std::endl;
+    }
+
+private:
+    static const uint32_t setCount = 4096;
+    static const VkDeviceSize blockSize = 1024; // what the three descriptors of a set cover
+
+    // Packed the way the update template reads it
+    struct SetData
+    {
+        VkDescriptorBufferInfo first;
+        VkDescriptorBufferInfo second;
+        VkDescriptorBufferInfo objects;
+    };
+
+    const vk::Device &device;
+    vk::Resource<VkDescriptorSetLayout> setLayout;
+    vk::DescriptorPool descPool;
+    std::array<VkDescriptorSet, setCount> sets;
+    vk::Buffer buffer;
+    vk::DescriptorUpdateTemplate updateTemplate;
+
+    // Sets point at different blocks each iteration so that no update is redundant
+    static auto getOffset(uint32_t set, uint32_t iteration) -> VkDeviceSize
+    {
+        return ((set + iteration) % setCount) * blockSize;
+    }
+
+    template <class F>
+    static auto measure(uint32_t iterations, F update) -> double
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+            update(i);
+        const std::chrono::duration<double, std::milli> time = std::chrono::high_resolution_clock::now() - start;
+        return time.count();
+    }
+};
+
+static const std::array<std::pair<VkPresentModeKHR, const char*>, 4> presentModeNames{{
+    {VK_PRESENT_MODE_FIFO_KHR, "fifo"},
+    {VK_PRESENT_MODE_FIFO_RELAXED_KHR, "fifo-relaxed"},
+    {VK_PRESENT_MODE_MAILBOX_KHR, "mailbox"},
+    {VK_PRESENT_MODE_IMMEDIATE_KHR, "immediate"}
+}};
+
+static auto getPresentModeName(VkPresentModeKHR mode) -> const char*
+{
+    for (const auto &name: presentModeNames)
+    {
+        if (name.first == mode)
+            return name.second;
+    }
+    return "unknown";
+}
+
+static auto parsePresentMode(const std::string &name) -> VkPresentModeKHR
+{
+    for (const auto &mode: presentModeNames)
+    {
+        if (name == mode.second)
+            return mode.first;
+    }
+    KL_PANIC("Unknown present mode");
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// Binary PPM of RGBA8 pixel rows
+static void writeFrame(const std::string &path, const void *pixels, uint32_t width, uint32_t height)
+{
+    const auto header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    std::vector<uint8_t> data(header.begin(), header.end());
+    data.reserve(data.size() + width * height * 3);
+
+    const auto rgba = static_cast<const uint8_t*>(pixels);
+    for (uint32_t i = 0; i < width * height; i++)
+        data.insert(data.end(), rgba + i * 4, rgba + i * 4 + 3);
+
+    fs::writeBytes(path, data.data(), data.size());
+}
+
+int main(int argc, char **argv)
 {
     const uint32_t canvasWidth = 1366;
     const uint32_t canvasHeight = 768;
 
-    Window window{canvasWidth, canvasHeight, "Demo"};
-    auto device = vk::Device::create(window.getPlatformHandle());
-    auto swapchain = vk::Swapchain(device, canvasWidth, canvasHeight, false);
+    // "--frames-in-flight 1" waits for each frame like a queue wait idle would, for comparing frame times.
+    // "--present-mode" and "--swapchain-images" trade latency for throughput, e.g. fifo with 2 images has the least
+    // queued frames with vsync, mailbox the least latency without tearing.
+    // "--headless N" renders N frames offscreen as fast as possible without a window, e.g. with a software
+    // implementation on a machine without a display, and writes the last one to Frame.ppm.
+    const auto mode = argc > 1 ? std::string(argv[1]) : std::string();
+    uint32_t frameCount = 2;
+    auto presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    uint32_t swapchainImageCount = 0;
+    uint64_t headlessFrameCount = 0;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const auto arg = std::string(argv[i]);
+        if (arg == "--frames-in-flight")
+            frameCount = static_cast<uint32_t>((std::max)(std::stoi(argv[i + 1]), 1));
+        else if (arg == "--present-mode")
+            presentMode = parsePresentMode(argv[i + 1]);
+        else if (arg == "--swapchain-images")
+            swapchainImageCount = static_cast<uint32_t>((std::max)(std::stoi(argv[i + 1]), 0));
+        else if (arg == "--headless")
+            headlessFrameCount = static_cast<uint64_t>((std::max)(std::stoll(argv[i + 1]), 1LL));
+    }
+
+    // The samples don't need a window either
+    const auto headless = headlessFrameCount > 0 || mode == "--compute-sample" || mode == "--descriptor-benchmark";
+
+    uptr<Window> window;
+    if (!headless)
+        window = std::make_unique<Window>(canvasWidth, canvasHeight, "Demo");
+    auto device = headless
+        ? vk::Device::createHeadless("PipelineCache.bin")
+        : vk::Device::create(window->getPlatformHandle(), "PipelineCache.bin");
+    std::cout << "Queue families: graphics " << device.getQueueIndex() << ", present " << device.getPresentQueueIndex()
+        << ", compute " << device.getComputeQueueIndex() << ", transfer " << device.getTransferQueueIndex() << std::endl;
+
+    if (mode == "--compute-sample")
+    {
+        ShaderCompiler shaderCompiler("ShaderCache_", {"../../assets/shaders"});
+        return ComputeSample(device, shaderCompiler).run(1 << 20, 2.5f) ? 0 : 1;
+    }
+
+    if (mode == "--descriptor-benchmark")
+    {
+        DescriptorUpdateBenchmark(device).run(100);
+        return 0;
+    }
+
+    vk::Swapchain swapchain;
+    if (!headless)
+    {
+        swapchain = vk::Swapchain(device, canvasWidth, canvasHeight, vk::SwapchainConfig()
+            .withPresentMode(presentMode)
+            .withImageCount(swapchainImageCount)
+            .withFrameCount(frameCount));
+    }
 
     Camera cam;
-    cam.setPerspective(glm::radians(45.0f), canvasWidth / (canvasHeight * 1.0f), 0.01f, 100);
+    auto aspectRatio = canvasWidth / (canvasHeight * 1.0f);
+    cam.setPerspective(glm::radians(45.0f), aspectRatio, 0.01f, 100);
     cam.getTransform().setLocalPosition({10, -5, 10});
     cam.getTransform().lookAt({0, 0, 0}, {0, 1, 0});
 
-    Scene scene{device};
-    Offscreen offscreen{device, canvasWidth, canvasHeight};
+    ThreadPool threadPool;
+    Scene scene{device, threadPool, frameCount, vk::TextureTable::isSupported(device)};
+    // Scopes of the offscreen pass, its draws and the post-processing in the swapchain pass
+    vk::GpuProfiler profiler{device, frameCount, 8};
+    Offscreen offscreen{device, canvasWidth, canvasHeight, frameCount, profiler, headless};
+
+    const auto loadStartTime = std::chrono::high_resolution_clock::now();
+
     Mesh mesh{device, offscreen.getRenderPass(), scene};
-    PostProcessor postProcessor{device, offscreen, scene};
+    // Only drawn in the swapchain pass. Headless, the color image is exported for readback and can't be sampled.
+    uptr<PostProcessor> postProcessor;
+    if (!headless)
+        postProcessor = std::make_unique<PostProcessor>(device, offscreen, scene, PostProcessor::Vignette);
     Skybox skybox{device, offscreen, scene};
     Axes axes{device, offscreen, scene};
     Label label{device, "Test", offscreen.getRenderPass(), scene};
 
+    scene.getPipelineCache().wait();
+    device.getUploadQueue().waitIdle();
+
+    const std::chrono::duration<double, std::milli> loadTime = std::chrono::high_resolution_clock::now() - loadStartTime;
+    const auto pipelineCacheStats = device.getPipelineCacheStats();
+    std::cout << "Created " << pipelineCacheStats.pipelineCount << " pipelines in " << pipelineCacheStats.creationTimeMs
+        << " ms (" << (pipelineCacheStats.warm ? "warm" : "cold") << " pipeline cache), "
+        << scene.getPipelineCache().getPipelineRequestCount() << " pipelines requested, "
+        << threadPool.getThreadCount() << " worker threads, scene loaded in " << loadTime.count() << " ms" << std::endl;
+
+    const auto memoryStats = device.getMemoryAllocator().getStats();
+    std::cout << "GPU memory: " << memoryStats.allocationCount << " allocations in " << memoryStats.blockCount << " blocks ("
+        << memoryStats.usedBytes / 1024 << " of " << memoryStats.blockBytes / 1024 << " KB used, "
+        << static_cast<int>(memoryStats.getInternalFragmentation() * 100) << "% internal / "
+        << static_cast<int>(memoryStats.getExternalFragmentation() * 100) << "% external fragmentation), "
+        << memoryStats.dedicatedAllocationCount << " dedicated allocations (" << memoryStats.dedicatedBytes / 1024 << " KB)" << std::endl;
+
+    const auto descStats = scene.getDescAllocator().getStats();
+    std::cout << "Descriptor sets: " << descStats.allocationCount << " allocated from " << descStats.poolCount << " pools, "
+        << static_cast<int>(descStats.getCacheHitRate() * 100) << "% cache hits ("
+        << descStats.cacheHits << " of " << descStats.cacheHits + descStats.cacheMisses << ")"
+        << (scene.getTextureTable() ? ", bindless textures" : "") << std::endl;
+
+    const auto graphStats = offscreen.getGraphStats();
+    std::cout << "Render graph: " << graphStats.passCount << " passes (" << graphStats.culledPassCount << " culled), "
+        << graphStats.imageCount << " images in " << graphStats.allocatedBytes / 1024 << " KB ("
+        << graphStats.imageBytes / 1024 << " KB without aliasing), " << graphStats.barrierCount << " barriers in "
+        << graphStats.barrierBatchCount << " batches per frame" << std::endl;
+
+    const auto stagingStats = device.getUploadQueue().getStagingStats();
+    std::cout << "Staging: " << stagingStats.ringHighWater / 1024 << " of " << stagingStats.ringSize / 1024
+        << " KB ring peak usage, " << stagingStats.largeBufferCount << " large buffers ("
+        << stagingStats.largeHighWater / 1024 << " KB peak usage)" << std::endl;
+
     // Record command buffers
 
-    {
-	    const VkCommandBuffer buf = offscreen.getCommandBuffer();
-        vk::beginCommandBuffer(buf, false);
+    uint32_t frameIndex = 0; // slot of the current frame
 
-        offscreen.getRenderPass().begin(buf, offscreen.getFrameBuffer(), canvasWidth, canvasHeight);
+    // Static geometry is drawn first from cached bundles, the rest is recorded each frame in drawing order
+    // (the label blends over what's drawn before it)
+    vk::CommandBundleCache bundleCache{device, frameCount};
+    const auto skyboxBundle = bundleCache.addBundle();
+    const auto axesBundle = bundleCache.addBundle();
 
-        auto vp = VkViewport{0, 0, canvasWidth, canvasHeight, 0, 1};
+    const auto skyboxScope = profiler.addScope("skybox", true);
+    const auto axesScope = profiler.addScope("axes", true);
+    const auto meshScope = profiler.addScope("mesh", true);
+    const auto labelScope = profiler.addScope("label", true);
+    const auto postProcessScope = profiler.addScope("post-process");
+
+    // Draws are timed within the secondary buffers they're recorded into
+    auto profileDraw = [&](VkCommandBuffer buf, uint32_t scope, const std::function<void()> &draw)
+    {
+        profiler.beginScope(buf, frameIndex, scope);
+        draw();
+        profiler.endScope(buf, frameIndex, scope);
+    };
 
-        vkCmdSetViewport(buf, 0, 1, &vp);
+    const std::vector<std::function<void(VkCommandBuffer)>> offscreenDraws =
+    {
+        [&](VkCommandBuffer buf) { profileDraw(buf, meshScope, [&] { mesh.render(buf); }); },
+        [&](VkCommandBuffer buf) { profileDraw(buf, labelScope, [&] { label.render(buf); }); }
+    };
 
-        VkRect2D scissor{{0, 0}, {vp.width, vp.height}};
-        vkCmdSetScissor(buf, 0, 1, &scissor);
+    // The demo scene has only a few draws, so it's split as finely as possible to exercise the workers
+    vk::ParallelRecorder offscreenRecorder{device, threadPool, frameCount, 1};
 
-        skybox.render(buf);
-        axes.render(buf);
-        mesh.render(buf);
-        label.render(buf);
+    // Re-recorded every frame since the dynamic offsets of the scene uniforms move around the ring.
+    // Draws are recorded into secondary buffers by the worker threads.
+    const Offscreen::DrawScene drawScene = [&](VkCommandBuffer buf, const vk::RenderGraphPassContext &context)
+    {
+        auto vp = VkViewport{0, 0, static_cast<float>(context.width), static_cast<float>(context.height), 0, 1};
+        VkRect2D scissor{{0, 0}, {context.width, context.height}};
 
-        offscreen.getRenderPass().end(buf); 
+        // Secondary buffers don't inherit dynamic state
+        auto setViewport = [&](VkCommandBuffer secondary)
+        {
+            vkCmdSetViewport(secondary, 0, 1, &vp);
+            vkCmdSetScissor(secondary, 0, 1, &scissor);
+        };
+
+        vk::CommandBundleKey skyboxKey;
+        skybox.appendBundleKey(skyboxKey.withViewport(vp, scissor));
+        bundleCache.execute(buf, frameIndex, skyboxBundle, context.renderPass, 0, context.framebuffer,
+            skyboxKey, [&](VkCommandBuffer secondary)
+        {
+            setViewport(secondary);
+            profileDraw(secondary, skyboxScope, [&] { skybox.render(secondary); });
+        });
+
+        vk::CommandBundleKey axesKey;
+        axes.appendBundleKey(axesKey.withViewport(vp, scissor));
+        bundleCache.execute(buf, frameIndex, axesBundle, context.renderPass, 0, context.framebuffer,
+            axesKey, [&](VkCommandBuffer secondary)
+        {
+            setViewport(secondary);
+            profileDraw(secondary, axesScope, [&] { axes.render(secondary); });
+        });
 
-        KL_VK_CHECK_RESULT(vkEndCommandBuffer(buf));
-    }
+        offscreenRecorder.record(buf, frameIndex, context.renderPass, 0, context.framebuffer,
+            offscreenDraws.size(), [&](VkCommandBuffer secondary, uint32_t first, uint32_t count)
+        {
+            setViewport(secondary);
+            for (auto i = first; i < first + count; i++)
+                offscreenDraws[i](secondary);
+        });
+    };
 
-    swapchain.recordCommandBuffers([&](VkFramebuffer fb, VkCommandBuffer buf)
+    if (!headless)
     {
-        swapchain.getRenderPass().begin(buf, fb, canvasWidth, canvasHeight);
+        swapchain.recordCommandBuffers([&](VkFramebuffer fb, VkCommandBuffer buf)
+        {
+            // Re-recorded at the new size when the swapchain is recreated
+            swapchain.getRenderPass().begin(buf, fb, swapchain.getWidth(), swapchain.getHeight());
 
-        auto vp = VkViewport{0, 0, static_cast<float>(canvasWidth), static_cast<float>(canvasHeight), 0, 1};
+            auto vp = VkViewport{0, 0, static_cast<float>(swapchain.getWidth()), static_cast<float>(swapchain.getHeight()), 0, 1};
 
-        vkCmdSetViewport(buf, 0, 1, &vp);
+            vkCmdSetViewport(buf, 0, 1, &vp);
 
-        VkRect2D scissor{{0, 0}, {vp.width, vp.height}};
-        vkCmdSetScissor(buf, 0, 1, &scissor);
+            VkRect2D scissor{{0, 0}, {vp.width, vp.height}};
+            vkCmdSetScissor(buf, 0, 1, &scissor);
 
-        postProcessor.render(buf);
+            postProcessor->render(buf);
 
-        swapchain.getRenderPass().end(buf);
-    });
+            swapchain.getRenderPass().end(buf);
+        });
+    }
+
+    // The swapchain pass is recorded once per image, so it's timed by command buffers of the frame slot
+    // submitted around it. It starts once the offscreen frame is done, at the stage waiting for it.
+    std::vector<std::array<vk::Resource<VkCommandBuffer>, 2>> postProcessTimers(frameCount);
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        for (auto &buf: postProcessTimers[i])
+        {
+            buf = vk::createCommandBuffer(device, device.getCommandPool());
+            vk::beginCommandBuffer(buf, false);
+        }
+        profiler.beginScope(postProcessTimers[i][0], i, postProcessScope, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        profiler.endScope(postProcessTimers[i][1], i, postProcessScope);
+        for (auto &buf: postProcessTimers[i])
+            KL_VK_CHECK_RESULT(vkEndCommandBuffer(buf));
+    }
 
     // Main loop
 
+    // Work on other queues, e.g. async compute, is added to the frame with dependencies on the offscreen work
+    vk::QueueScheduler scheduler{device, frameCount};
+
+    // Stands in for compute work consuming the frame, e.g. post-processing or readback processing
+    ComputeSample asyncCompute{device, scene.getShaderCompiler(), frameCount};
+    asyncCompute.recordFrames(frameCount, 1 << 16, 2.5f);
+
     Input input;
+    uint64_t frame = 0;
+    double recordTime = 0;
+    const auto loopStartTime = std::chrono::high_resolution_clock::now();
+    auto labelTime = loopStartTime;
+    uint64_t labelFrame = 0;
 
-    while (!window.closeRequested() && !input.isKeyPressed(SDLK_ESCAPE, true))
+    while (headless ? frame < headlessFrameCount : !window->closeRequested() && !input.isKeyPressed(SDLK_ESCAPE, true))
     {
-        window.beginUpdate(input);
-
-	    const auto dt = window.getTimeDelta();
+        // Waits for the frame that used the same slot, everything older than that is complete as well.
+        // Without a swapchain the scheduler's fences of the slot do.
+        VkSemaphore presentCompleteSemaphore = VK_NULL_HANDLE;
+        if (headless)
+            frameIndex = static_cast<uint32_t>(frame % frameCount);
+        else
+        {
+            window->beginUpdate(input);
+            presentCompleteSemaphore = swapchain.acquireNext();
+            if (!presentCompleteSemaphore)
+            {
+                // Nothing to present to while minimized, don't spin until the window changes
+                window->endUpdate();
+                window->waitForEvents(100);
+                continue;
+            }
+            frameIndex = swapchain.getFrameIndex();
+
+            // The offscreen image is stretched over the swapchain, so the projection follows the window's shape
+            const auto swapchainAspectRatio = swapchain.getWidth() / (swapchain.getHeight() * 1.0f);
+            if (swapchainAspectRatio != aspectRatio)
+            {
+                aspectRatio = swapchainAspectRatio;
+                cam.setPerspective(glm::radians(45.0f), aspectRatio, 0.01f, 100);
+            }
+            applySpectator(cam.getTransform(), input, window->getTimeDelta(), 1, 5);
+        }
+        scheduler.beginFrame(frameIndex);
+        if (frame >= frameCount)
+            device.getDeletionQueue().release(frame - frameCount);
+        device.getDeletionQueue().beginFrame(frame);
+
+        // The label shows the frame rate. Its old buffers are dropped while frames using them are still in flight.
+        const auto now = std::chrono::high_resolution_clock::now();
+        if (now - labelTime >= std::chrono::seconds(1))
+        {
+            label.setText(std::to_string(frame - labelFrame) + " fps");
+            labelTime = now;
+            labelFrame = frame;
+        }
 
-        applySpectator(cam.getTransform(), input, dt, 1, 5);
         scene.update(cam);
+        const auto recordStartTime = std::chrono::high_resolution_clock::now();
+        offscreen.record(frameIndex, drawScene);
+        recordTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStartTime).count();
 
-        auto presentCompleteSemaphore = swapchain.acquireNext();
-        vk::queueSubmit(device.getQueue(), 1, &presentCompleteSemaphore, 1, &offscreen.getSemaphore(), 1, &offscreen.getCommandBuffer());
-        swapchain.presentNext(device.getQueue(), 1, &offscreen.getSemaphore());
-        KL_VK_CHECK_RESULT(vkQueueWaitIdle(device.getQueue()));
+        // Uploads issued during the frame must be submitted before the work that uses them
+        device.getUploadQueue().flush();
 
-        window.endUpdate();
+        auto &offscreenSemaphore = offscreen.getSemaphore(frameIndex);
+        const auto offscreenWork = scheduler.addWork(device.getQueue(), offscreen.getCommandBuffer(frameIndex));
+        if (!headless)
+        {
+            scheduler.addWait(offscreenWork, presentCompleteSemaphore, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+            scheduler.addSignal(offscreenWork, offscreenSemaphore);
+        }
+        const auto computeWork = scheduler.addWork(device.getComputeQueue(), asyncCompute.getFrameCommandBuffer(frameIndex));
+        scheduler.addDependency(computeWork, offscreenWork, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        scheduler.submit();
+        if (!headless)
+        {
+            swapchain.presentNext(device.getQueue(), 1, &offscreenSemaphore,
+                postProcessTimers[frameIndex][0], postProcessTimers[frameIndex][1]);
+        }
+        frame++;
+
+        if (!headless)
+            window->endUpdate();
+    }
+
+    const std::chrono::duration<double, std::milli> loopTime = std::chrono::high_resolution_clock::now() - loopStartTime;
+    if (frame)
+    {
+        std::cout << frame << " frames with " << frameCount << " in flight, " << loopTime.count() / frame
+            << " ms per frame on average, " << recordTime / frame << " ms of it recording "
+            << offscreenRecorder.getRangeCount(offscreenDraws.size()) << " command buffer ranges" << std::endl;
+
+        if (headless)
+        {
+            std::cout << "Headless: " << canvasWidth << "x" << canvasHeight << " at "
+                << 1000 * frame / loopTime.count() << " frames per second" << std::endl;
+        }
+        else
+        {
+            const auto swapchainStats = swapchain.getStats();
+            std::cout << "Swapchain: " << getPresentModeName(swapchainStats.presentMode) << " with "
+                << swapchainStats.imageCount << " images, " << swapchainStats.recreateCount << " recreations, "
+                << swapchainStats.acquireWaitMs / frame << " ms per frame waiting to acquire, "
+                << swapchainStats.acquireToPresentMs / frame << " ms from acquire to present" << std::endl;
+            if (swapchainStats.latencyCount)
+            {
+                std::cout << "Frame latency from acquire to completion: " << swapchainStats.latencyMs / swapchainStats.latencyCount
+                    << " ms on average, " << swapchainStats.maxLatencyMs << " ms max" << std::endl;
+            }
+        }
+
+        for (uint32_t i = 0; i < profiler.getScopeCount(); i++)
+        {
+            const auto stats = profiler.getScopeStats(i);
+            if (!stats.sampleCount)
+                continue;
+            std::cout << "GPU " << profiler.getScopeName(i) << ": " << stats.averageMs << " ms average, "
+                << stats.medianMs << " median, " << stats.p95Ms << " p95, " << stats.p99Ms << " p99, "
+                << stats.maxMs << " max";
+            if (stats.statisticsSampleCount)
+            {
+                std::cout << ", " << stats.inputAssemblyPrimitives << " primitives, " << stats.vertexShaderInvocations
+                    << " vertex and " << stats.fragmentShaderInvocations << " fragment invocations";
+            }
+            std::cout << std::endl;
+        }
+
+        const auto bundleStats = bundleCache.getStats();
+        std::cout << "Command bundles: " << bundleStats.recordCount << " recordings, "
+            << bundleStats.replayCount << " replays" << std::endl;
     }
 
+    KL_VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+    device.savePipelineCache();
+
+    if (headless)
+        writeFrame("Frame.ppm", offscreen.getReadbackData(frameIndex), canvasWidth, canvasHeight);
+
     return 0;
 }
@@ -0,0 +1,146 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "ShaderCompiler.h"
+#include "FileSystem.h"
+#include "StringUtils.h"
+#include "HashUtils.h"
+#include "Common.h"
+#include <shaderc/shaderc.hpp>
+#include <sstream>
+#include <iomanip>
+
+class Includer: public shaderc::CompileOptions::IncluderInterface
+{
+public:
+    explicit Includer(const std::vector<std::string> &includeDirs):
+        includeDirs(includeDirs)
+    {
+    }
+
+    auto GetInclude(const char *requestedSource, shaderc_include_type type, const char *requestingSource,
+        size_t includeDepth) -> shaderc_include_result* override
+    {
+        auto result = new Result();
+
+        std::vector<std::string> candidates;
+        if (type == shaderc_include_type_relative)
+            candidates.push_back(getDirectory(requestingSource) + requestedSource);
+        for (const auto &dir: includeDirs)
+            candidates.push_back(dir + "/" + requestedSource);
+
+        for (const auto &path: candidates)
+        {
+            if (fs::exists(path))
+            {
+                const auto bytes = fs::readBytes(path);
+                result->path = path;
+                result->text.assign(bytes.begin(), bytes.end());
+                break;
+            }
+        }
+
+        // An empty source name tells shaderc that the include failed, the content is then used as the error message
+        if (result->path.empty())
+            result->text = std::string("Could not resolve include ") + requestedSource;
+
+        result->source_name = result->path.c_str();
+        result->source_name_length = result->path.size();
+        result->content = result->text.c_str();
+        result->content_length = result->text.size();
+        result->user_data = nullptr;
+
+        return result;
+    }
+
+    void ReleaseInclude(shaderc_include_result *data) override
+    {
+        delete static_cast<Result*>(data);
+    }
+
+private:
+    struct Result: shaderc_include_result
+    {
+        std::string path;
+        std::string text;
+    };
+
+    std::vector<std::string> includeDirs;
+
+    static auto getDirectory(const std::string &path) -> std::string
+    {
+        const auto slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    }
+};
+
+static auto getShaderKind(const std::string &path) -> shaderc_shader_kind
+{
+    if (strutils::endsWith(path, ".vert"))
+        return shaderc_vertex_shader;
+    if (strutils::endsWith(path, ".frag"))
+        return shaderc_fragment_shader;
+    if (strutils::endsWith(path, ".comp"))
+        return shaderc_compute_shader;
+    KL_PANIC("Unsupported shader file extension");
+    return shaderc_glsl_infer_from_source;
+}
+
+static const auto optimizationLevel = shaderc_optimization_level_performance;
+
+ShaderCompiler::ShaderCompiler(const std::string &cachePathPrefix, std::vector<std::string> includeDirs):
+    cachePathPrefix(cachePathPrefix),
+    includeDirs(std::move(includeDirs))
+{
+}
+
+auto ShaderCompiler::compile(const std::string &path, const Defines &defines) -> std::vector<uint32_t>
+{
+    const auto kind = getShaderKind(path);
+    const auto sourceBytes = fs::readBytes(path);
+    const std::string source(sourceBytes.begin(), sourceBytes.end());
+
+    shaderc::CompileOptions options;
+    options.SetOptimizationLevel(optimizationLevel);
+    options.SetIncluder(std::make_unique<Includer>(includeDirs));
+    for (const auto &define: defines)
+        options.AddMacroDefinition(define.first, define.second);
+
+    shaderc::Compiler compiler;
+
+    // Preprocessing is cheap compared to compilation and gives a key that accounts for includes and defines
+    const auto preprocessed = compiler.PreprocessGlsl(source, kind, path.c_str(), options);
+    KL_PANIC_IF(preprocessed.GetCompilationStatus() != shaderc_compilation_status_success, preprocessed.GetErrorMessage().c_str());
+
+    const std::string preprocessedSource(preprocessed.cbegin(), preprocessed.cend());
+    auto hash = hashutils::fnv1a(preprocessedSource.data(), preprocessedSource.size());
+    hash = hashutils::fnv1a(&kind, sizeof(kind), hash);
+    hash = hashutils::fnv1a(&optimizationLevel, sizeof(optimizationLevel), hash);
+
+    std::ostringstream cachePath;
+    cachePath << cachePathPrefix << std::hex << std::setw(16) << std::setfill('0') << hash << ".spv";
+
+    if (fs::exists(cachePath.str()))
+    {
+        const auto bytes = fs::readBytes(cachePath.str());
+        if (!bytes.empty() && bytes.size() % sizeof(uint32_t) == 0)
+        {
+            cacheHits++;
+            std::vector<uint32_t> spirv(bytes.size() / sizeof(uint32_t));
+            memcpy(spirv.data(), bytes.data(), bytes.size());
+            return spirv;
+        }
+    }
+
+    cacheMisses++;
+
+    const auto compiled = compiler.CompileGlslToSpv(preprocessedSource, kind, path.c_str(), options);
+    KL_PANIC_IF(compiled.GetCompilationStatus() != shaderc_compilation_status_success, compiled.GetErrorMessage().c_str());
+
+    std::vector<uint32_t> spirv(compiled.cbegin(), compiled.cend());
+    fs::writeBytes(cachePath.str(), spirv.data(), spirv.size() * sizeof(uint32_t));
+
+    return spirv;
+}
@@ -0,0 +1,39 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+
+// Compiles GLSL to SPIR-V at runtime. Results are cached on disk, keyed by a hash of the preprocessed source and
+// compile options, so that unchanged shaders (including their #includes and defines) skip compilation on subsequent
+// runs. Cache files are named cachePathPrefix + hash, a relative prefix puts them in the working directory.
+class ShaderCompiler
+{
+public:
+    using Defines = std::vector<std::pair<std::string, std::string>>;
+
+    ShaderCompiler(const std::string &cachePathPrefix, std::vector<std::string> includeDirs = {});
+    ShaderCompiler(const ShaderCompiler &other) = delete;
+    ShaderCompiler(ShaderCompiler &&other) = default;
+    ~ShaderCompiler() {}
+
+    auto operator=(const ShaderCompiler &other) -> ShaderCompiler& = delete;
+    auto operator=(ShaderCompiler &&other) -> ShaderCompiler& = default;
+
+    // Shader stage is deduced from the file extension (.vert, .frag, .comp)
+    auto compile(const std::string &path, const Defines &defines = {}) -> std::vector<uint32_t>;
+
+    auto getCacheHitCount() const -> uint32_t { return cacheHits; }
+    auto getCacheMissCount() const -> uint32_t { return cacheMisses; }
+
+private:
+    std::string cachePathPrefix;
+    std::vector<std::string> includeDirs;
+    uint32_t cacheHits = 0;
+    uint32_t cacheMisses = 0;
+};
@@ -0,0 +1,48 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    if (!threadCount)
+        threadCount = std::thread::hardware_concurrency();
+    if (!threadCount)
+        threadCount = 1;
+
+    for (uint32_t i = 0; i < threadCount; i++)
+        threads.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto &thread: threads)
+        thread.join();
+}
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+
+        task();
+    }
+}
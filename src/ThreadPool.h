@@ -0,0 +1,55 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Common.h"
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+class ThreadPool
+{
+public:
+    // Zero means one thread per hardware thread
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ThreadPool(const ThreadPool &other) = delete;
+    ThreadPool(ThreadPool &&other) = delete;
+    ~ThreadPool();
+
+    auto operator=(const ThreadPool &other) -> ThreadPool& = delete;
+    auto operator=(ThreadPool &&other) -> ThreadPool& = delete;
+
+    template <class F>
+    auto enqueue(F &&task) -> std::future<decltype(task())>
+    {
+        // std::function requires copyable callables, hence the shared packaged_task
+        auto packagedTask = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<F>(task));
+        auto future = packagedTask->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push([packagedTask] { (*packagedTask)(); });
+        }
+        condition.notify_one();
+
+        return future;
+    }
+
+    auto getThreadCount() const -> uint32_t { return threads.size(); }
+
+private:
+    std::vector<std::thread> threads;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    void work();
+};
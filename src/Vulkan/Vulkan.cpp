@@ -38,7 +38,7 @@ auto vk::createFrameBuffer(VkDevice device, VkImageView colorAttachment, VkImage
     createInfo.height = height;
     createInfo.layers = 1;
 
-    Resource<VkFramebuffer> frameBuffer{device, vkDestroyFramebuffer};
+    Resource<VkFramebuffer> frameBuffer{device};
     KL_VK_CHECK_RESULT(vkCreateFramebuffer(device, &createInfo, nullptr, frameBuffer.cleanRef()));
 
     return frameBuffer;
@@ -51,22 +51,47 @@ auto vk::createSemaphore(VkDevice device) -> Resource<VkSemaphore>
     semaphoreCreateInfo.pNext = nullptr;
     semaphoreCreateInfo.flags = 0;
 
-    Resource<VkSemaphore> semaphore{device, vkDestroySemaphore};
+    Resource<VkSemaphore> semaphore{device};
     KL_VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, semaphore.cleanRef()));
 
     return semaphore;
 }
 
-auto vk::createCommandBuffer(VkDevice device, VkCommandPool commandPool) -> Resource<VkCommandBuffer>
+auto vk::createFence(VkDevice device, bool signaled) -> Resource<VkFence>
+{
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = signaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0;
+
+    Resource<VkFence> fence{device};
+    KL_VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, fence.cleanRef()));
+
+    return fence;
+}
+
+auto vk::createCommandPool(VkDevice device, uint32_t queueIndex, VkCommandPoolCreateFlags flags) -> Resource<VkCommandPool>
+{
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueIndex;
+    poolInfo.flags = flags;
+
+    Resource<VkCommandPool> commandPool{device};
+    KL_VK_CHECK_RESULT(vkCreateCommandPool(device, &poolInfo, nullptr, commandPool.cleanRef()));
+
+    return commandPool;
+}
+
+auto vk::createCommandBuffer(VkDevice device, VkCommandPool commandPool, VkCommandBufferLevel level) -> Resource<VkCommandBuffer>
 {
     VkCommandBufferAllocateInfo allocateInfo{};
     allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocateInfo.pNext = nullptr;
     allocateInfo.commandPool = commandPool;
-    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.level = level;
     allocateInfo.commandBufferCount = 1;
 
-    Resource<VkCommandBuffer> buffer{device, commandPool, vkFreeCommandBuffers};
+    Resource<VkCommandBuffer> buffer{device, commandPool};
     KL_VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &allocateInfo, &buffer));
 
     return buffer;
@@ -96,7 +121,7 @@ auto vk::createImageView(VkDevice device, VkFormat format, VkImageViewType type,
     viewInfo.subresourceRange.levelCount = mipLevels;
     viewInfo.image = image;
 
-    Resource<VkImageView> view{device, vkDestroyImageView};
+    Resource<VkImageView> view{device};
     KL_VK_CHECK_RESULT(vkCreateImageView(device, &viewInfo, nullptr, view.cleanRef()));
 
     return view;
@@ -111,41 +136,47 @@ auto vk::createShader(VkDevice device, const void *data, size_t size) -> Resourc
     shaderModuleInfo.codeSize = size;
     shaderModuleInfo.pCode = reinterpret_cast<const uint32_t*>(data);
 
-    Resource<VkShaderModule> module{device, vkDestroyShaderModule};
+    Resource<VkShaderModule> module{device};
     KL_VK_CHECK_RESULT(vkCreateShaderModule(device, &shaderModuleInfo, nullptr, module.cleanRef()));
 
     return module;
 }
 
-auto vk::createShaderStageInfo(bool vertex, VkShaderModule shader, const char *entryPoint) -> VkPipelineShaderStageCreateInfo
+auto vk::createShader(VkDevice device, const std::vector<uint32_t> &spirv) -> Resource<VkShaderModule>
+{
+    return createShader(device, spirv.data(), spirv.size() * sizeof(uint32_t));
+}
+
+auto vk::createShaderStageInfo(VkShaderStageFlagBits stage, VkShaderModule shader, const char *entryPoint,
+    const VkSpecializationInfo *specializationInfo) -> VkPipelineShaderStageCreateInfo
 {
     VkPipelineShaderStageCreateInfo info{};
     info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     info.pNext = nullptr;
     info.flags = 0;
-    info.stage = vertex ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+    info.stage = stage;
     info.module = shader;
     info.pName = entryPoint;
-    info.pSpecializationInfo = nullptr;
+    info.pSpecializationInfo = specializationInfo;
     return info;
 }
 
 void vk::queueSubmit(VkQueue queue, uint32_t waitSemaphoreCount, const VkSemaphore *waitSemaphores,
     uint32_t signalSemaphoreCount, const VkSemaphore *signalSemaphores,
-    uint32_t commandBufferCount, const VkCommandBuffer *commandBuffers)
+    uint32_t commandBufferCount, const VkCommandBuffer *commandBuffers, VkFence fence, VkPipelineStageFlags waitStages)
 {
-    VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    const std::vector<VkPipelineStageFlags> submitPipelineStages(waitSemaphoreCount, waitStages);
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pWaitDstStageMask = &submitPipelineStages;
+    submitInfo.pWaitDstStageMask = submitPipelineStages.data();
     submitInfo.waitSemaphoreCount = waitSemaphoreCount;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.signalSemaphoreCount = signalSemaphoreCount;
     submitInfo.pSignalSemaphores = signalSemaphores;
     submitInfo.commandBufferCount = commandBufferCount;
     submitInfo.pCommandBuffers = commandBuffers;
-    KL_VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+    KL_VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
 }
 
 void vk::queuePresent(VkQueue queue, const Swapchain &swapchain, uint32_t swapchainStep,
@@ -173,11 +204,42 @@ auto vk::createDebugCallback(VkInstance instance, PFN_vkDebugReportCallbackEXT c
     auto create = reinterpret_cast<PFN_vkCreateDebugReportCallbackEXT>(vkGetInstanceProcAddr(instance, "vkCreateDebugReportCallbackEXT"));
     KL_PANIC_IF(!create, "Failed to load pointer to vkCreateDebugReportCallbackEXT");
 
-    auto destroy = reinterpret_cast<PFN_vkDestroyDebugReportCallbackEXT>(vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT"));
-    KL_PANIC_IF(!destroy, "Failed to load pointer to vkDestroyDebugReportCallbackEXT");
-
-    Resource<VkDebugReportCallbackEXT> result{instance, destroy};
+    Resource<VkDebugReportCallbackEXT> result{instance};
     KL_VK_CHECK_RESULT(create(instance, &createInfo, nullptr, result.cleanRef()));
 
     return result;
-}
\ No newline at end of file
+}
+
+void vk::bufferBarrier(VkCommandBuffer cmdBuf, VkBuffer buffer, VkAccessFlags srcAccess, VkPipelineStageFlags srcStage,
+    VkAccessFlags dstAccess, VkPipelineStageFlags dstStage)
+{
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(cmdBuf, srcStage, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void vk::imageBarrier(VkCommandBuffer cmdBuf, VkImage image, VkImageAspectFlags aspectMask,
+    VkImageLayout oldLayout, VkAccessFlags srcAccess, VkPipelineStageFlags srcStage,
+    VkImageLayout newLayout, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {aspectMask, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+
+    vkCmdPipelineBarrier(cmdBuf, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
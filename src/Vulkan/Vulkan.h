@@ -12,6 +12,7 @@
 #   define VK_USE_PLATFORM_WIN32_KHR
 #endif
 #include <vulkan.h>
+#include <vector>
 
 #ifdef KL_DEBUG
 #   define KL_VK_CHECK_RESULT(vkCall, ...) KL_PANIC_IF(vkCall != VK_SUCCESS, __VA_ARGS__)
@@ -27,16 +28,42 @@ namespace vk
     auto createFrameBuffer(VkDevice device, VkImageView colorAttachment, VkImageView depthAttachment,
         VkRenderPass renderPass, uint32_t width, uint32_t height) -> Resource<VkFramebuffer>;
     auto createSemaphore(VkDevice device) -> Resource<VkSemaphore>;
-    auto createCommandBuffer(VkDevice device, VkCommandPool commandPool) -> Resource<VkCommandBuffer>;
+    auto createFence(VkDevice device, bool signaled) -> Resource<VkFence>;
+    auto createCommandPool(VkDevice device, uint32_t queueIndex, VkCommandPoolCreateFlags flags) -> Resource<VkCommandPool>;
+    auto createCommandBuffer(VkDevice device, VkCommandPool commandPool,
+        VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) -> Resource<VkCommandBuffer>;
     auto createShader(VkDevice device, const void *data, size_t size) -> Resource<VkShaderModule>;
-    auto createShaderStageInfo(bool vertex, VkShaderModule shader, const char *entryPoint) -> VkPipelineShaderStageCreateInfo;
+    auto createShader(VkDevice device, const std::vector<uint32_t> &spirv) -> Resource<VkShaderModule>;
+    auto createShaderStageInfo(VkShaderStageFlagBits stage, VkShaderModule shader, const char *entryPoint,
+        const VkSpecializationInfo *specializationInfo = nullptr) -> VkPipelineShaderStageCreateInfo;
     void queueSubmit(VkQueue queue, uint32_t waitSemaphoreCount, const VkSemaphore *waitSemaphores,
         uint32_t signalSemaphoreCount, const VkSemaphore *signalSemaphores,
-        uint32_t commandBufferCount, const VkCommandBuffer *commandBuffers);
+        uint32_t commandBufferCount, const VkCommandBuffer *commandBuffers,
+        VkFence fence = VK_NULL_HANDLE, VkPipelineStageFlags waitStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
     void queuePresent(VkQueue queue, const Swapchain &swapchain, uint32_t swapchainStep,
         uint32_t waitSemaphoreCount, const VkSemaphore *waitSemaphores);
     auto createDebugCallback(VkInstance instance, PFN_vkDebugReportCallbackEXT callbackFunc) -> Resource<VkDebugReportCallbackEXT>;
     void beginCommandBuffer(VkCommandBuffer buffer, bool oneTime);
     auto createImageView(VkDevice device, VkFormat format, VkImageViewType type, uint32_t mipLevels, uint32_t layers,
         VkImage image, VkImageAspectFlags aspectMask) -> Resource<VkImageView>;
+
+    // Number of workgroups needed to cover itemCount invocations
+    inline auto getGroupCount(uint32_t itemCount, uint32_t localSize) -> uint32_t
+    {
+        return (itemCount + localSize - 1) / localSize;
+    }
+
+    // Execution + memory dependency for the whole buffer/all subresources of the image, without queue ownership transfer
+    void bufferBarrier(VkCommandBuffer cmdBuf, VkBuffer buffer, VkAccessFlags srcAccess, VkPipelineStageFlags srcStage,
+        VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+    void imageBarrier(VkCommandBuffer cmdBuf, VkImage image, VkImageAspectFlags aspectMask,
+        VkImageLayout oldLayout, VkAccessFlags srcAccess, VkPipelineStageFlags srcStage,
+        VkImageLayout newLayout, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage);
+
+    template <class T>
+    void pushConstants(VkCommandBuffer buffer, VkPipelineLayout layout, VkShaderStageFlags stages, const T &value, uint32_t offset = 0)
+    {
+        static_assert(sizeof(T) % 4 == 0, "Push constant size must be a multiple of 4");
+        vkCmdPushConstants(buffer, layout, stages, offset, sizeof(T), &value);
+    }
 }
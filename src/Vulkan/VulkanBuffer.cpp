@@ -6,6 +6,48 @@
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
 
+// How buffer contents are read once uploaded, judging by the buffer usage
+static auto getReadAccess(VkBufferUsageFlags usage, VkPipelineStageFlags &stages) -> VkAccessFlags
+{
+    const auto shaderStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    VkAccessFlags access = 0;
+    stages = 0;
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+    {
+        access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+    {
+        access |= VK_ACCESS_INDEX_READ_BIT;
+        stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    }
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+    {
+        access |= VK_ACCESS_UNIFORM_READ_BIT;
+        stages |= shaderStages;
+    }
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+    {
+        access |= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        stages |= shaderStages;
+    }
+    if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)
+    {
+        access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        stages |= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    }
+    if (!stages)
+    {
+        access = VK_ACCESS_MEMORY_READ_BIT;
+        stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+
+    return access;
+}
+
 auto vk::Buffer::createStaging(const Device &device, VkDeviceSize size, const void *initialData) -> Buffer
 {
     auto buffer = Buffer(device, size,
@@ -27,17 +69,20 @@ auto vk::Buffer::createUniformHostVisible(const Device &device, VkDeviceSize siz
 
 auto vk::Buffer::createDeviceLocal(const Device &device, VkDeviceSize size, VkBufferUsageFlags usageFlags, const void *data) -> Buffer
 {
-    auto stagingBuffer = createStaging(device, size, data);
-
     auto buffer = Buffer(device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usageFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    stagingBuffer.transferTo(buffer, device.getQueue(), device.getCommandPool());
 
-    return std::move(buffer);
+    // Contents arrive asynchronously, but before any work submitted to the main queue after the next upload flush
+    VkPipelineStageFlags dstStages = 0;
+    const auto dstAccess = getReadAccess(usageFlags, dstStages);
+    device.getUploadQueue().uploadBuffer(buffer.getHandle(), data, size, dstAccess, dstStages);
+
+    return buffer;
 }
 
 vk::Buffer::Buffer(const Device &device, VkDeviceSize size, VkBufferUsageFlags usageFlags,
     VkMemoryPropertyFlags memPropertyFlags):
     device(device),
+    deletionQueue(&device.getDeletionQueue()),
     size(size)
 {
     VkBufferCreateInfo bufferInfo {};
@@ -49,28 +94,46 @@ vk::Buffer::Buffer(const Device &device, VkDeviceSize size, VkBufferUsageFlags u
     bufferInfo.queueFamilyIndexCount = 0;
     bufferInfo.pQueueFamilyIndices = nullptr;
 
-    buffer = Resource<VkBuffer>{device, vkDestroyBuffer};
+    buffer = Resource<VkBuffer>{device};
     KL_VK_CHECK_RESULT(vkCreateBuffer(device, &bufferInfo, nullptr, buffer.cleanRef()));
 
     VkMemoryRequirements memReqs;
     vkGetBufferMemoryRequirements(device, buffer, &memReqs);
 
-    VkMemoryAllocateInfo allocInfo {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReqs.size;
-    allocInfo.memoryTypeIndex = findMemoryType(device.getPhysicalMemoryFeatures(), memReqs.memoryTypeBits, memPropertyFlags);
+    memory = device.getMemoryAllocator().allocate(memReqs, memPropertyFlags, false);
+    KL_VK_CHECK_RESULT(vkBindBufferMemory(device, buffer, memory.getMemory(), memory.getOffset()));
+}
 
-    memory = Resource<VkDeviceMemory>{device, vkFreeMemory};
-    KL_VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, memory.cleanRef()));
-    KL_VK_CHECK_RESULT(vkBindBufferMemory(device, buffer, memory, 0));
+vk::Buffer::~Buffer()
+{
+    retire();
+}
+
+auto vk::Buffer::operator=(Buffer &&other) -> Buffer&
+{
+    if (this != &other)
+    {
+        retire();
+        device = other.device;
+        deletionQueue = other.deletionQueue;
+        memory = std::move(other.memory);
+        buffer = std::move(other.buffer);
+        size = other.size;
+    }
+    return *this;
 }
 
 void vk::Buffer::update(const void *newData) const
 {
-    void *ptr = nullptr;
-	KL_VK_CHECK_RESULT(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &ptr));
-	memcpy(ptr, newData, size);
-	vkUnmapMemory(device, memory);
+    // Memory is shared with other resources and can't be mapped per buffer, it stays mapped instead
+    KL_PANIC_IF(!memory.getMappedData(), "Buffer is not host-visible");
+    memcpy(memory.getMappedData(), newData, size);
+}
+
+void vk::Buffer::read(void *data) const
+{
+    KL_PANIC_IF(!memory.getMappedData(), "Buffer is not host-visible");
+    memcpy(data, memory.getMappedData(), size);
 }
 
 void vk::Buffer::transferTo(const Buffer &dst, VkQueue queue, VkCommandPool cmdPool) const
@@ -87,3 +150,11 @@ void vk::Buffer::transferTo(const Buffer &dst, VkQueue queue, VkCommandPool cmdP
     queueSubmit(queue, 0, nullptr, 0, nullptr, 1, &cmdBuf);
     KL_VK_CHECK_RESULT(vkQueueWaitIdle(queue));
 }
+
+void vk::Buffer::retire()
+{
+    if (!deletionQueue)
+        return;
+    deletionQueue->defer(std::move(buffer));
+    deletionQueue->defer(std::move(memory));
+}
@@ -6,11 +6,15 @@
 #pragma once
 
 #include "Vulkan.h"
+#include "VulkanMemoryAllocator.h"
 
 namespace vk
 {
     class Device;
+    class DeletionQueue;
 
+    // Destroying or replacing a buffer hands it to the device's DeletionQueue, so it can be dropped while frames
+    // using it are in flight
     class Buffer
     {
     public:
@@ -22,22 +26,27 @@ namespace vk
         Buffer(const Device &device, VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memPropertyFlags);
         Buffer(Buffer &&other) = default;
         Buffer(const Buffer &other) = delete;
-        ~Buffer() {}
+        ~Buffer();
 
         auto operator=(const Buffer &other) -> Buffer& = delete;
-        auto operator=(Buffer &&other) -> Buffer& = default;
+        auto operator=(Buffer &&other) -> Buffer&;
 
         operator VkBuffer() { return buffer; }
 
         auto getHandle() const -> VkBuffer { return buffer; }
+        auto getMappedData() const -> void* { return memory.getMappedData(); } // null unless host-visible
 
         void update(const void *newData) const;
+        void read(void *data) const; // for host-visible buffers
         void transferTo(const Buffer& other, VkQueue queue, VkCommandPool cmdPool) const;
 
     private:
         VkDevice device = nullptr;
-        Resource<VkDeviceMemory> memory;
+        DeletionQueue *deletionQueue = nullptr;
+        Allocation memory;
         Resource<VkBuffer> buffer;
         VkDeviceSize size = 0;
+
+        void retire();
     };
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanCommandBundleCache.h"
+#include "VulkanDevice.h"
+#include <cstring>
+
+auto vk::CommandBundleKey::withPipeline(VkPipeline pipeline) -> CommandBundleKey&
+{
+    values.push_back((uint64_t) pipeline);
+    return *this;
+}
+
+auto vk::CommandBundleKey::withDescriptorSets(const std::vector<VkDescriptorSet> &sets,
+    const std::vector<uint32_t> &dynamicOffsets) -> CommandBundleKey&
+{
+    // Counts go first so that different splits of the same values don't compare equal
+    values.push_back(sets.size());
+    for (const auto set: sets)
+        values.push_back((uint64_t) set);
+    values.push_back(dynamicOffsets.size());
+    values.insert(values.end(), dynamicOffsets.begin(), dynamicOffsets.end());
+    return *this;
+}
+
+auto vk::CommandBundleKey::withViewport(const VkViewport &viewport, const VkRect2D &scissor) -> CommandBundleKey&
+{
+    const float floats[] = {viewport.x, viewport.y, viewport.width, viewport.height, viewport.minDepth, viewport.maxDepth};
+    for (const auto value: floats)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        values.push_back(bits);
+    }
+    values.push_back(static_cast<uint32_t>(scissor.offset.x));
+    values.push_back(static_cast<uint32_t>(scissor.offset.y));
+    values.push_back(scissor.extent.width);
+    values.push_back(scissor.extent.height);
+    return *this;
+}
+
+auto vk::CommandBundleKey::withVersion(uint32_t version) -> CommandBundleKey&
+{
+    values.push_back(version);
+    return *this;
+}
+
+vk::CommandBundleCache::CommandBundleCache(const Device &device, uint32_t frameCount):
+    device(device),
+    frameCount(frameCount)
+{
+    pool = createCommandPool(device, device.getQueueIndex(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+}
+
+auto vk::CommandBundleCache::addBundle() -> uint32_t
+{
+    const auto id = static_cast<uint32_t>(bundles.size() / frameCount);
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        Bundle bundle;
+        bundle.buffer = createCommandBuffer(device, pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        bundles.push_back(std::move(bundle));
+    }
+    return id;
+}
+
+void vk::CommandBundleCache::execute(VkCommandBuffer primary, uint32_t frameIndex, uint32_t bundleId, VkRenderPass renderPass,
+    uint32_t subpass, VkFramebuffer framebuffer, const CommandBundleKey &key, const Record &record)
+{
+    auto &bundle = bundles[bundleId * frameCount + frameIndex];
+
+    auto fullKey = key;
+    fullKey.values.push_back((uint64_t) renderPass);
+    fullKey.values.push_back(subpass);
+    fullKey.values.push_back((uint64_t) framebuffer);
+
+    if (bundle.valid && bundle.key == fullKey)
+        stats.replayCount++;
+    else
+    {
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = subpass;
+        inheritanceInfo.framebuffer = framebuffer;
+
+        // Not one-time, the buffer is executed again in later frames. Beginning resets it.
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+        KL_VK_CHECK_RESULT(vkBeginCommandBuffer(bundle.buffer, &beginInfo));
+        record(bundle.buffer);
+        KL_VK_CHECK_RESULT(vkEndCommandBuffer(bundle.buffer));
+
+        bundle.key = std::move(fullKey);
+        bundle.valid = true;
+        stats.recordCount++;
+    }
+
+    vkCmdExecuteCommands(primary, 1, &bundle.buffer);
+}
+
+void vk::CommandBundleCache::invalidate()
+{
+    for (auto &bundle: bundles)
+        bundle.valid = false;
+}
@@ -0,0 +1,86 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include <vector>
+#include <functional>
+
+namespace vk
+{
+    class Device;
+
+    // State that recorded commands depend on, a bundle is re-recorded when it differs from the recorded one
+    class CommandBundleKey
+    {
+    public:
+        auto withPipeline(VkPipeline pipeline) -> CommandBundleKey&;
+        auto withDescriptorSets(const std::vector<VkDescriptorSet> &sets, const std::vector<uint32_t> &dynamicOffsets = {}) -> CommandBundleKey&;
+        auto withViewport(const VkViewport &viewport, const VkRect2D &scissor) -> CommandBundleKey&;
+        // E.g. Transform::getVersion() of an object whose data goes into the commands
+        auto withVersion(uint32_t version) -> CommandBundleKey&;
+
+        bool operator==(const CommandBundleKey &other) const { return values == other.values; }
+        bool operator!=(const CommandBundleKey &other) const { return values != other.values; }
+
+    private:
+        friend class CommandBundleCache;
+
+        std::vector<uint64_t> values;
+    };
+
+    struct CommandBundleStats
+    {
+        uint32_t recordCount = 0;
+        uint32_t replayCount = 0; // executions without re-recording
+    };
+
+    // Secondary command buffers recorded once and executed each frame until their key changes.
+    // Bundles are kept per frame in flight, so a changed one is re-recorded only in buffers the GPU is done with.
+    // Not thread-safe.
+    class CommandBundleCache
+    {
+    public:
+        using Record = std::function<void(VkCommandBuffer buf)>;
+
+        CommandBundleCache() {}
+        CommandBundleCache(const Device &device, uint32_t frameCount);
+        CommandBundleCache(const CommandBundleCache &other) = delete;
+        CommandBundleCache(CommandBundleCache &&other) = default;
+        ~CommandBundleCache() {}
+
+        auto operator=(const CommandBundleCache &other) -> CommandBundleCache& = delete;
+        auto operator=(CommandBundleCache &&other) -> CommandBundleCache& = default;
+
+        // Returns the id to execute the bundle with
+        auto addBundle() -> uint32_t;
+
+        // Executes the bundle from the primary buffer, which must be inside the render pass begun with
+        // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. Commands are recorded first if the key, render pass or
+        // framebuffer changed. Viewport and scissor aren't inherited, so the commands must set them.
+        void execute(VkCommandBuffer primary, uint32_t frameIndex, uint32_t bundleId, VkRenderPass renderPass,
+            uint32_t subpass, VkFramebuffer framebuffer, const CommandBundleKey &key, const Record &record);
+
+        // Forces re-recording of all bundles, e.g. when resources they use are destroyed
+        void invalidate();
+
+        auto getStats() const -> CommandBundleStats { return stats; }
+
+    private:
+        struct Bundle
+        {
+            Resource<VkCommandBuffer> buffer;
+            CommandBundleKey key;
+            bool valid = false;
+        };
+
+        VkDevice device = nullptr;
+        Resource<VkCommandPool> pool;
+        uint32_t frameCount = 0;
+        std::vector<Bundle> bundles; // frameCount per bundle id
+        CommandBundleStats stats;
+    };
+}
@@ -0,0 +1,93 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanComputePipeline.h"
+#include "VulkanDevice.h"
+#include "VulkanShaderReflection.h"
+#include <chrono>
+
+vk::ComputePipelineConfig::ComputePipelineConfig(VkShaderModule shader):
+    shader(shader)
+{
+}
+
+auto vk::ComputePipelineConfig::withDescriptorSetLayout(VkDescriptorSetLayout layout) -> ComputePipelineConfig&
+{
+    descSetLayouts.push_back(layout);
+    return *this;
+}
+
+auto vk::ComputePipelineConfig::withDescriptorSetLayouts(const std::vector<VkDescriptorSetLayout> &layouts) -> ComputePipelineConfig&
+{
+    descSetLayouts.insert(descSetLayouts.end(), layouts.begin(), layouts.end());
+    return *this;
+}
+
+auto vk::ComputePipelineConfig::withPushConstants(uint32_t offset, uint32_t size) -> ComputePipelineConfig&
+{
+    KL_PANIC_IF(offset % 4 || size % 4, "Push constant offset and size must be multiples of 4");
+
+    VkPushConstantRange range{};
+    range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    range.offset = offset;
+    range.size = size;
+    pushConstantRanges.push_back(range);
+
+    return *this;
+}
+
+auto vk::ComputePipelineConfig::withPushConstants(const ShaderReflection &reflection) -> ComputePipelineConfig&
+{
+    const auto &pushConstants = reflection.getPushConstants();
+    if (pushConstants.size)
+        withPushConstants(pushConstants.offset, pushConstants.size);
+    return *this;
+}
+
+vk::ComputePipeline::ComputePipeline(const Device &device, const ComputePipelineConfig &config)
+{
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = nullptr;
+    layoutInfo.flags = 0;
+    layoutInfo.setLayoutCount = config.descSetLayouts.size();
+    layoutInfo.pSetLayouts = config.descSetLayouts.data();
+    layoutInfo.pushConstantRangeCount = config.pushConstantRanges.size();
+    layoutInfo.pPushConstantRanges = config.pushConstantRanges.data();
+
+    Resource<VkPipelineLayout> layout{device};
+    KL_VK_CHECK_RESULT(vkCreatePipelineLayout(device, &layoutInfo, nullptr, layout.cleanRef()));
+
+    const auto constants = config.constants.getInfo();
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stage = createShaderStageInfo(VK_SHADER_STAGE_COMPUTE_BIT, config.shader, "main", &constants);
+    pipelineInfo.layout = layout;
+    pipelineInfo.basePipelineHandle = nullptr;
+    pipelineInfo.basePipelineIndex = -1;
+
+    const auto startTime = std::chrono::high_resolution_clock::now();
+
+    Resource<VkPipeline> pipeline{device};
+    KL_VK_CHECK_RESULT(vkCreateComputePipelines(device, device.getPipelineCache(), 1, &pipelineInfo, nullptr, pipeline.cleanRef()));
+
+    const std::chrono::duration<double, std::milli> creationTime = std::chrono::high_resolution_clock::now() - startTime;
+    device.notifyPipelineCreated(creationTime.count());
+
+    this->pipeline = std::move(pipeline);
+    this->layout = std::move(layout);
+}
+
+void vk::ComputePipeline::dispatch(VkCommandBuffer cmdBuf, const std::vector<VkDescriptorSet> &descSets,
+    uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) const
+{
+    vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    if (!descSets.empty())
+        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, descSets.size(), descSets.data(), 0, nullptr);
+    vkCmdDispatch(cmdBuf, groupCountX, groupCountY, groupCountZ);
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanPipeline.h"
+#include <vector>
+
+namespace vk
+{
+    class Device;
+    class ShaderReflection;
+
+    class ComputePipelineConfig
+    {
+    public:
+        explicit ComputePipelineConfig(VkShaderModule shader);
+        ~ComputePipelineConfig() {}
+
+        auto withDescriptorSetLayout(VkDescriptorSetLayout layout) -> ComputePipelineConfig&;
+        auto withDescriptorSetLayouts(const std::vector<VkDescriptorSetLayout> &layouts) -> ComputePipelineConfig&;
+        auto withPushConstants(uint32_t offset, uint32_t size) -> ComputePipelineConfig&;
+        auto withPushConstants(const ShaderReflection &reflection) -> ComputePipelineConfig&;
+
+        template <class T>
+        auto withSpecializationConstant(uint32_t constantId, const T &value) -> ComputePipelineConfig&
+        {
+            constants.set(constantId, value);
+            return *this;
+        }
+
+    private:
+        friend class ComputePipeline;
+
+        VkShaderModule shader;
+        std::vector<VkDescriptorSetLayout> descSetLayouts;
+        std::vector<VkPushConstantRange> pushConstantRanges;
+        SpecializationConstants constants;
+    };
+
+    class ComputePipeline
+    {
+    public:
+        ComputePipeline() {}
+        ComputePipeline(const Device &device, const ComputePipelineConfig &config);
+        ComputePipeline(const ComputePipeline &other) = delete;
+        ComputePipeline(ComputePipeline &&other) = default;
+        ~ComputePipeline() {}
+
+        auto operator=(const ComputePipeline &other) -> ComputePipeline& = delete;
+        auto operator=(ComputePipeline &&other) -> ComputePipeline& = default;
+
+        operator VkPipeline() { return pipeline; }
+
+        auto getHandle() const -> VkPipeline { return pipeline; }
+        auto getLayout() const -> VkPipelineLayout { return layout; }
+
+        // Binds the pipeline and sets (starting from set 0) and dispatches the given number of workgroups
+        void dispatch(VkCommandBuffer cmdBuf, const std::vector<VkDescriptorSet> &descSets,
+            uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1) const;
+
+    private:
+        Resource<VkPipeline> pipeline;
+        Resource<VkPipelineLayout> layout;
+    };
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanDeletionQueue.h"
+
+vk::DeletionQueue::~DeletionQueue()
+{
+    flush();
+}
+
+void vk::DeletionQueue::defer(Allocation &&allocation)
+{
+    if (!allocation.getMemory())
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    getCurrentFrame().allocations.push_back(std::move(allocation));
+}
+
+void vk::DeletionQueue::defer(const RetiredResource &resource)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    getCurrentFrame().resources.push_back(resource);
+}
+
+void vk::DeletionQueue::beginFrame(uint64_t frame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    currentFrame = frame;
+}
+
+void vk::DeletionQueue::release(uint64_t completeFrame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!frames.empty() && frames.front().frame <= completeFrame)
+    {
+        destroy(frames.front());
+        spare.push_back(std::move(frames.front()));
+        frames.pop_front();
+    }
+}
+
+void vk::DeletionQueue::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &frame: frames)
+        destroy(frame);
+    frames.clear();
+}
+
+auto vk::DeletionQueue::getPendingCount() const -> uint32_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t count = 0;
+    for (const auto &frame: frames)
+        count += frame.resources.size() + frame.allocations.size();
+    return count;
+}
+
+auto vk::DeletionQueue::getCurrentFrame() -> Frame&
+{
+    if (frames.empty() || frames.back().frame != currentFrame)
+    {
+        if (!spare.empty())
+        {
+            frames.push_back(std::move(spare.back()));
+            spare.pop_back();
+        }
+        else
+            frames.push_back(Frame());
+        frames.back().frame = currentFrame;
+    }
+    return frames.back();
+}
+
+void vk::DeletionQueue::destroy(Frame &frame)
+{
+    // Objects go before the memory bound to them
+    for (const auto &resource: frame.resources)
+        resource.destroy(resource);
+    frame.resources.clear();
+    frame.allocations.clear();
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include <vector>
+#include <deque>
+#include <mutex>
+
+namespace vk
+{
+    // Keeps objects that are no longer needed on the CPU side alive until the GPU has finished the frames that
+    // could still be using them. Releasing never waits, it only destroys what the caller reports as complete.
+    // Thread-safe.
+    class DeletionQueue
+    {
+    public:
+        DeletionQueue() {}
+        DeletionQueue(const DeletionQueue &other) = delete;
+        DeletionQueue(DeletionQueue &&other) = delete;
+        ~DeletionQueue();
+
+        auto operator=(const DeletionQueue &other) -> DeletionQueue& = delete;
+        auto operator=(DeletionQueue &&other) -> DeletionQueue& = delete;
+
+        template <class T>
+        void defer(Resource<T> &&resource)
+        {
+            if (resource)
+                defer(resource.retire());
+        }
+
+        void defer(Allocation &&allocation);
+
+        // Objects deferred from now on are destroyed once this frame is complete. Frame numbers must not decrease.
+        void beginFrame(uint64_t frame);
+        // The GPU is done with all frames up to and including this one
+        void release(uint64_t completeFrame);
+        // Destroys everything right away, the device must be idle
+        void flush();
+
+        auto getPendingCount() const -> uint32_t;
+
+    private:
+        struct Frame
+        {
+            uint64_t frame = 0;
+            std::vector<RetiredResource> resources;
+            std::vector<Allocation> allocations;
+        };
+
+        std::deque<Frame> frames; // oldest first
+        std::vector<Frame> spare; // emptied frames, their vectors keep capacity
+        uint64_t currentFrame = 0;
+        mutable std::mutex mutex;
+
+        void defer(const RetiredResource &resource);
+        auto getCurrentFrame() -> Frame&;
+        void destroy(Frame &frame);
+    };
+}
@@ -0,0 +1,175 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanDescriptorAllocator.h"
+#include "../HashUtils.h"
+#include <algorithm>
+#include <tuple>
+
+auto vk::DescriptorBindings::withUniformBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset,
+    VkDeviceSize range) -> DescriptorBindings&
+{
+    items.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, binding, {buffer, offset, range}, {}});
+    return *this;
+}
+
+auto vk::DescriptorBindings::withDynamicUniformBuffer(uint32_t binding, VkBuffer buffer,
+    VkDeviceSize range) -> DescriptorBindings&
+{
+    items.push_back({VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, binding, {buffer, 0, range}, {}});
+    return *this;
+}
+
+auto vk::DescriptorBindings::withStorageBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset,
+    VkDeviceSize range) -> DescriptorBindings&
+{
+    items.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, binding, {buffer, offset, range}, {}});
+    return *this;
+}
+
+auto vk::DescriptorBindings::withDynamicStorageBuffer(uint32_t binding, VkBuffer buffer,
+    VkDeviceSize range) -> DescriptorBindings&
+{
+    items.push_back({VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, binding, {buffer, 0, range}, {}});
+    return *this;
+}
+
+auto vk::DescriptorBindings::withTexture(uint32_t binding, VkImageView view, VkSampler sampler,
+    VkImageLayout layout) -> DescriptorBindings&
+{
+    items.push_back({VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding, {}, {sampler, view, layout}});
+    return *this;
+}
+
+auto vk::DescriptorBindings::withStorageImage(uint32_t binding, VkImageView view,
+    VkImageLayout layout) -> DescriptorBindings&
+{
+    items.push_back({VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, binding, {}, {VK_NULL_HANDLE, view, layout}});
+    return *this;
+}
+
+auto vk::DescriptorBindings::hash() const -> size_t
+{
+    size_t result = 0;
+    for (const auto &item: items)
+    {
+        hashutils::combine(result, item.type);
+        hashutils::combine(result, item.binding);
+        hashutils::combine(result, item.buffer.buffer);
+        hashutils::combine(result, item.buffer.offset);
+        hashutils::combine(result, item.buffer.range);
+        hashutils::combine(result, item.image.sampler);
+        hashutils::combine(result, item.image.imageView);
+        hashutils::combine(result, item.image.imageLayout);
+    }
+    return result;
+}
+
+bool vk::DescriptorBindings::operator==(const DescriptorBindings &other) const
+{
+    return std::equal(items.begin(), items.end(), other.items.begin(), other.items.end(),
+        [](const Item &a, const Item &b)
+        {
+            return std::tie(a.type, a.binding, a.buffer.buffer, a.buffer.offset, a.buffer.range,
+                a.image.sampler, a.image.imageView, a.image.imageLayout) ==
+                std::tie(b.type, b.binding, b.buffer.buffer, b.buffer.offset, b.buffer.range,
+                b.image.sampler, b.image.imageView, b.image.imageLayout);
+        });
+}
+
+vk::DescriptorAllocator::DescriptorAllocator(VkDevice device, uint32_t setsPerPool, const DescriptorPoolConfig &poolConfig):
+    device(device),
+    setsPerPool(setsPerPool),
+    poolConfig(poolConfig),
+    mutex(std::make_unique<std::mutex>())
+{
+}
+
+auto vk::DescriptorAllocator::allocate(VkDescriptorSetLayout layout) -> VkDescriptorSet
+{
+    std::lock_guard<std::mutex> lock(*mutex);
+    return allocateSet(layout);
+}
+
+auto vk::DescriptorAllocator::getSet(VkDescriptorSetLayout layout, const DescriptorBindings &bindings) -> VkDescriptorSet
+{
+    std::lock_guard<std::mutex> lock(*mutex);
+
+    SetKey key{layout, bindings};
+    const auto existing = cache.find(key);
+    if (existing != cache.end())
+    {
+        stats.cacheHits++;
+        return existing->second;
+    }
+
+    stats.cacheMisses++;
+    const auto set = allocateSet(layout);
+
+    std::vector<VkWriteDescriptorSet> writes;
+    for (const auto &item: bindings.items)
+    {
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = item.binding;
+        write.dstArrayElement = 0;
+        write.descriptorType = item.type;
+        write.descriptorCount = 1;
+        write.pBufferInfo = item.buffer.buffer ? &item.buffer : nullptr;
+        write.pImageInfo = item.image.imageView ? &item.image : nullptr;
+        writes.push_back(write);
+    }
+    vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
+
+    cache.emplace(std::move(key), set);
+
+    return set;
+}
+
+void vk::DescriptorAllocator::reset()
+{
+    std::lock_guard<std::mutex> lock(*mutex);
+    for (auto &pool: pools)
+        pool.reset();
+    currentPool = 0;
+    cache.clear();
+}
+
+auto vk::DescriptorAllocator::getStats() const -> DescriptorAllocatorStats
+{
+    std::lock_guard<std::mutex> lock(*mutex);
+    auto result = stats;
+    result.poolCount = pools.size();
+    return result;
+}
+
+auto vk::DescriptorAllocator::SetKeyHash::operator()(const SetKey &key) const -> size_t
+{
+    auto result = key.bindings.hash();
+    hashutils::combine(result, key.layout);
+    return result;
+}
+
+auto vk::DescriptorAllocator::allocateSet(VkDescriptorSetLayout layout) -> VkDescriptorSet
+{
+    VkDescriptorSet set = VK_NULL_HANDLE;
+
+    for (; currentPool < pools.size(); currentPool++)
+    {
+        if (pools[currentPool].tryAllocateSet(layout, set))
+        {
+            stats.allocationCount++;
+            return set;
+        }
+    }
+
+    pools.emplace_back(device, setsPerPool, poolConfig);
+    if (!pools.back().tryAllocateSet(layout, set))
+        KL_PANIC("Descriptor set doesn't fit into an empty pool");
+    stats.allocationCount++;
+
+    return set;
+}
@@ -0,0 +1,109 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanDescriptorPool.h"
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+namespace vk
+{
+    // Resources bound to a descriptor set, used as the descriptor set cache key
+    class DescriptorBindings
+    {
+    public:
+        auto withUniformBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) -> DescriptorBindings&;
+        auto withDynamicUniformBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize range) -> DescriptorBindings&;
+        auto withStorageBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) -> DescriptorBindings&;
+        auto withDynamicStorageBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize range) -> DescriptorBindings&;
+        auto withTexture(uint32_t binding, VkImageView view, VkSampler sampler, VkImageLayout layout) -> DescriptorBindings&;
+        auto withStorageImage(uint32_t binding, VkImageView view, VkImageLayout layout) -> DescriptorBindings&;
+
+        auto hash() const -> size_t;
+        bool operator==(const DescriptorBindings &other) const;
+
+    private:
+        friend class DescriptorAllocator;
+
+        struct Item
+        {
+            VkDescriptorType type;
+            uint32_t binding;
+            VkDescriptorBufferInfo buffer;
+            VkDescriptorImageInfo image;
+        };
+
+        std::vector<Item> items;
+    };
+
+    struct DescriptorAllocatorStats
+    {
+        uint32_t poolCount = 0;
+        uint32_t allocationCount = 0; // sets allocated so far, including ones freed by resets
+        uint32_t cacheHits = 0;
+        uint32_t cacheMisses = 0;
+
+        auto getCacheHitRate() const -> float
+        {
+            const auto requests = cacheHits + cacheMisses;
+            return requests ? static_cast<float>(cacheHits) / requests : 0;
+        }
+    };
+
+    // Allocates descriptor sets from a chain of pools and adds a pool whenever the existing ones run out.
+    // Sets with identical layouts and bindings are allocated and written once and then shared.
+    // reset() frees all sets at once, so an allocator per frame in flight can hold short-lived sets. Thread-safe.
+    class DescriptorAllocator
+    {
+    public:
+        DescriptorAllocator() {}
+        // Every pool in the chain is created with room for this many sets and descriptors
+        DescriptorAllocator(VkDevice device, uint32_t setsPerPool, const DescriptorPoolConfig &poolConfig);
+        DescriptorAllocator(const DescriptorAllocator &other) = delete;
+        DescriptorAllocator(DescriptorAllocator &&other) = default;
+        ~DescriptorAllocator() {}
+
+        auto operator=(const DescriptorAllocator &other) -> DescriptorAllocator& = delete;
+        auto operator=(DescriptorAllocator &&other) -> DescriptorAllocator& = default;
+
+        // The set is not cached, it's up to the caller to update it
+        auto allocate(VkDescriptorSetLayout layout) -> VkDescriptorSet;
+        // Cached set with the resources bound. The resources must stay alive as long as the allocator isn't reset.
+        auto getSet(VkDescriptorSetLayout layout, const DescriptorBindings &bindings) -> VkDescriptorSet;
+
+        // Frees all sets, the GPU must be done with them
+        void reset();
+
+        auto getStats() const -> DescriptorAllocatorStats;
+
+    private:
+        struct SetKey
+        {
+            VkDescriptorSetLayout layout;
+            DescriptorBindings bindings;
+
+            bool operator==(const SetKey &other) const { return layout == other.layout && bindings == other.bindings; }
+        };
+
+        struct SetKeyHash
+        {
+            auto operator()(const SetKey &key) const -> size_t;
+        };
+
+        VkDevice device = nullptr;
+        uint32_t setsPerPool = 0;
+        DescriptorPoolConfig poolConfig;
+        std::vector<DescriptorPool> pools;
+        uint32_t currentPool = 0; // earlier pools are full
+        std::unordered_map<SetKey, VkDescriptorSet, SetKeyHash> cache;
+        DescriptorAllocatorStats stats;
+        uptr<std::mutex> mutex;
+
+        auto allocateSet(VkDescriptorSetLayout layout) -> VkDescriptorSet;
+    };
+}
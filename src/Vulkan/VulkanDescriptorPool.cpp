@@ -10,11 +10,12 @@ vk::DescriptorPool::DescriptorPool(VkDevice device, uint32_t maxSetCount, const
 {
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = config.flags;
     poolInfo.poolSizeCount = config.sizes.size();
     poolInfo.pPoolSizes = config.sizes.data();
     poolInfo.maxSets = maxSetCount;
 
-    Resource<VkDescriptorPool> pool{device, vkDestroyDescriptorPool};
+    Resource<VkDescriptorPool> pool{device};
     KL_VK_CHECK_RESULT(vkCreateDescriptorPool(device, &poolInfo, nullptr, pool.cleanRef()));
 
     this->pool = std::move(pool);
@@ -34,6 +35,28 @@ auto vk::DescriptorPool::allocateSet(VkDescriptorSetLayout layout) const -> VkDe
     return set;
 }
 
+auto vk::DescriptorPool::tryAllocateSet(VkDescriptorSetLayout layout, VkDescriptorSet &set) const -> bool
+{
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    const auto result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+    // Drivers without VK_KHR_maintenance1 may report running out of pool memory as out of device memory
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY_KHR || result == VK_ERROR_FRAGMENTED_POOL || result == VK_ERROR_OUT_OF_DEVICE_MEMORY)
+        return false;
+    KL_PANIC_IF(result != VK_SUCCESS, "Failed to allocate descriptor set");
+
+    return true;
+}
+
+void vk::DescriptorPool::reset()
+{
+    KL_VK_CHECK_RESULT(vkResetDescriptorPool(device, pool, 0));
+}
+
 auto vk::DescriptorPoolConfig::forDescriptors(VkDescriptorType descriptorType, uint32_t descriptorCount) -> DescriptorPoolConfig&
 {
     VkDescriptorPoolSize poolSize{};
@@ -42,3 +65,9 @@ auto vk::DescriptorPoolConfig::forDescriptors(VkDescriptorType descriptorType, u
     sizes.push_back(poolSize);
     return *this;
 }
+
+auto vk::DescriptorPoolConfig::withFlags(VkDescriptorPoolCreateFlags flags) -> DescriptorPoolConfig&
+{
+    this->flags = flags;
+    return *this;
+}
@@ -14,11 +14,13 @@ namespace vk
     {
     public:
         auto forDescriptors(VkDescriptorType descriptorType, uint32_t descriptorCount) -> DescriptorPoolConfig&;
+        auto withFlags(VkDescriptorPoolCreateFlags flags) -> DescriptorPoolConfig&;
 
     private:
         friend class DescriptorPool;
 
         std::vector<VkDescriptorPoolSize> sizes;
+        VkDescriptorPoolCreateFlags flags = 0;
     };
 
     class DescriptorPool
@@ -34,6 +36,11 @@ namespace vk
         auto operator=(DescriptorPool &&other) -> DescriptorPool& = default;
 
         auto allocateSet(VkDescriptorSetLayout layout) const -> VkDescriptorSet;
+        // Returns false if the pool is out of sets or descriptors
+        auto tryAllocateSet(VkDescriptorSetLayout layout, VkDescriptorSet &set) const -> bool;
+
+        // Returns all sets to the pool
+        void reset();
 
     private:
         VkDevice device = nullptr;
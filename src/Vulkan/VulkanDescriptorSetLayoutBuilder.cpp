@@ -11,7 +11,7 @@ vk::DescriptorSetLayoutBuilder::DescriptorSetLayoutBuilder(VkDevice device):
 }
 
 auto vk::DescriptorSetLayoutBuilder::withBinding(uint32_t binding, VkDescriptorType descriptorType, uint32_t descriptorCount,
-    VkShaderStageFlagBits stageFlags) -> DescriptorSetLayoutBuilder&
+    VkShaderStageFlags stageFlags) -> DescriptorSetLayoutBuilder&
 {
     if (binding >= bindings.size())
         bindings.resize(binding + 1);
@@ -25,14 +25,38 @@ auto vk::DescriptorSetLayoutBuilder::withBinding(uint32_t binding, VkDescriptorT
     return *this;
 }
 
-auto vk::DescriptorSetLayoutBuilder::build() -> Resource<VkDescriptorSetLayout>
+auto vk::DescriptorSetLayoutBuilder::withBindingFlags(uint32_t binding, VkDescriptorBindingFlagsEXT flags) -> DescriptorSetLayoutBuilder&
 {
+    if (binding >= bindingFlags.size())
+        bindingFlags.resize(binding + 1);
+    bindingFlags[binding] = flags;
+    return *this;
+}
+
+auto vk::DescriptorSetLayoutBuilder::withFlags(VkDescriptorSetLayoutCreateFlags flags) -> DescriptorSetLayoutBuilder&
+{
+    this->flags = flags;
+    return *this;
+}
+
+auto vk::DescriptorSetLayoutBuilder::build() const -> Resource<VkDescriptorSetLayout>
+{
+    auto flags = bindingFlags;
+    flags.resize(bindings.size());
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flagsInfo{};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+    flagsInfo.bindingCount = flags.size();
+    flagsInfo.pBindingFlags = flags.data();
+
     VkDescriptorSetLayoutCreateInfo layoutInfo {};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = bindingFlags.empty() ? nullptr : &flagsInfo;
+    layoutInfo.flags = this->flags;
     layoutInfo.bindingCount = bindings.size();
     layoutInfo.pBindings = bindings.data();
 
-    Resource<VkDescriptorSetLayout> result{device, vkDestroyDescriptorSetLayout};
+    Resource<VkDescriptorSetLayout> result{device};
     KL_VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, result.cleanRef()));
     
     return result;
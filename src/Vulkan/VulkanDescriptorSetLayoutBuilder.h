@@ -6,6 +6,7 @@
 #pragma once
 
 #include "Vulkan.h"
+#include "VulkanExtensions.h"
 #include <vector>
 
 namespace vk
@@ -16,12 +17,19 @@ namespace vk
         explicit DescriptorSetLayoutBuilder(VkDevice device);
 
         auto withBinding(uint32_t binding, VkDescriptorType descriptorType, uint32_t descriptorCount,
-            VkShaderStageFlagBits stageFlags) -> DescriptorSetLayoutBuilder&;
+            VkShaderStageFlags stageFlags) -> DescriptorSetLayoutBuilder&;
+        // Requires VK_EXT_descriptor_indexing, see DeviceExtensions
+        auto withBindingFlags(uint32_t binding, VkDescriptorBindingFlagsEXT flags) -> DescriptorSetLayoutBuilder&;
+        auto withFlags(VkDescriptorSetLayoutCreateFlags flags) -> DescriptorSetLayoutBuilder&;
 
-        auto build() -> Resource<VkDescriptorSetLayout>;
+        auto build() const -> Resource<VkDescriptorSetLayout>;
+
+        auto getBindings() const -> const std::vector<VkDescriptorSetLayoutBinding>& { return bindings; }
 
     private:
         VkDevice device = nullptr;
         std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlagsEXT> bindingFlags; // empty unless set for some binding
+        VkDescriptorSetLayoutCreateFlags flags = 0;
     };
 }
\ No newline at end of file
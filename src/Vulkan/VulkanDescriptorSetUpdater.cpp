@@ -4,6 +4,27 @@
 */
 
 #include "VulkanDescriptorSetUpdater.h"
+#include "VulkanDevice.h"
+
+static bool isBufferDescriptor(VkDescriptorType type)
+{
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+        type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+static bool isTexelBufferDescriptor(VkDescriptorType type)
+{
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+}
+
+static auto getDescriptorInfoSize(VkDescriptorType type) -> size_t
+{
+    if (isBufferDescriptor(type))
+        return sizeof(VkDescriptorBufferInfo);
+    if (isTexelBufferDescriptor(type))
+        return sizeof(VkBufferView);
+    return sizeof(VkDescriptorImageInfo);
+}
 
 vk::DescriptorSetUpdater::DescriptorSetUpdater(VkDevice device):
     device(device)
@@ -13,14 +34,42 @@ vk::DescriptorSetUpdater::DescriptorSetUpdater(VkDevice device):
 auto vk::DescriptorSetUpdater::forUniformBuffer(uint32_t binding, VkDescriptorSet set, VkBuffer buffer,
     VkDeviceSize offset, VkDeviceSize range) -> DescriptorSetUpdater&
 {
-    items.push_back({{buffer, offset, range}, {}, binding, set});
+    items.push_back({{buffer, offset, range}, {}, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, binding, set});
+    return *this;
+}
+
+auto vk::DescriptorSetUpdater::forDynamicUniformBuffer(uint32_t binding, VkDescriptorSet set, VkBuffer buffer,
+    VkDeviceSize range) -> DescriptorSetUpdater&
+{
+    items.push_back({{buffer, 0, range}, {}, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, binding, set});
     return *this;
 }
 
 auto vk::DescriptorSetUpdater::forTexture(uint32_t binding, VkDescriptorSet set, VkImageView view,
     VkSampler sampler, VkImageLayout layout) -> DescriptorSetUpdater&
 {
-    items.push_back({{}, {sampler, view, layout}, binding, set});
+    items.push_back({{}, {sampler, view, layout}, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, binding, set});
+    return *this;
+}
+
+auto vk::DescriptorSetUpdater::forStorageBuffer(uint32_t binding, VkDescriptorSet set, VkBuffer buffer,
+    VkDeviceSize offset, VkDeviceSize range) -> DescriptorSetUpdater&
+{
+    items.push_back({{buffer, offset, range}, {}, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, binding, set});
+    return *this;
+}
+
+auto vk::DescriptorSetUpdater::forDynamicStorageBuffer(uint32_t binding, VkDescriptorSet set, VkBuffer buffer,
+    VkDeviceSize range) -> DescriptorSetUpdater&
+{
+    items.push_back({{buffer, 0, range}, {}, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, binding, set});
+    return *this;
+}
+
+auto vk::DescriptorSetUpdater::forStorageImage(uint32_t binding, VkDescriptorSet set, VkImageView view,
+    VkImageLayout layout) -> DescriptorSetUpdater&
+{
+    items.push_back({{}, {nullptr, view, layout}, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, binding, set});
     return *this;
 }
 
@@ -32,14 +81,13 @@ void vk::DescriptorSetUpdater::updateSets()
     {
         auto bufferInfo = item.buffer.buffer ? &item.buffer : nullptr;
         auto imageInfo = item.image.imageView ? &item.image : nullptr;
-        auto type = bufferInfo ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 
         VkWriteDescriptorSet write{};
         write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         write.dstSet = item.targetSet;
         write.dstBinding = item.binding;
         write.dstArrayElement = 0;
-        write.descriptorType = type;
+        write.descriptorType = item.type;
         write.descriptorCount = 1;
         write.pBufferInfo = bufferInfo;
         write.pImageInfo = imageInfo;
@@ -49,3 +97,76 @@ void vk::DescriptorSetUpdater::updateSets()
 
     vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
 }
+
+auto vk::DescriptorUpdateTemplateConfig::withEntry(uint32_t binding, VkDescriptorType type, size_t offset,
+    uint32_t count, size_t stride) -> DescriptorUpdateTemplateConfig&
+{
+    VkDescriptorUpdateTemplateEntryKHR entry{};
+    entry.dstBinding = binding;
+    entry.dstArrayElement = 0;
+    entry.descriptorCount = count;
+    entry.descriptorType = type;
+    entry.offset = offset;
+    entry.stride = stride ? stride : getDescriptorInfoSize(type);
+    entries.push_back(entry);
+    return *this;
+}
+
+vk::DescriptorUpdateTemplate::DescriptorUpdateTemplate(const Device &device, VkDescriptorSetLayout layout,
+    const DescriptorUpdateTemplateConfig &config):
+    device(device),
+    entries(config.entries)
+{
+    const auto &extensions = device.getExtensions();
+    if (!extensions.descriptorUpdateTemplate)
+        return;
+
+    VkDescriptorUpdateTemplateCreateInfoKHR templateInfo{};
+    templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+    templateInfo.descriptorUpdateEntryCount = entries.size();
+    templateInfo.pDescriptorUpdateEntries = entries.data();
+    templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+    templateInfo.descriptorSetLayout = layout;
+
+    handle = Resource<VkDescriptorUpdateTemplateKHR>{device};
+    KL_VK_CHECK_RESULT(extensions.createDescriptorUpdateTemplate(device, &templateInfo, nullptr, handle.cleanRef()));
+    updateWithTemplate = extensions.updateDescriptorSetWithTemplate;
+}
+
+void vk::DescriptorUpdateTemplate::update(VkDescriptorSet set, const void *data) const
+{
+    if (handle)
+    {
+        updateWithTemplate(device, set, handle, data);
+        return;
+    }
+
+    // Same layout of the data, one write per array element since the stride can be anything
+    writes.clear();
+    for (const auto &entry: entries)
+    {
+        for (uint32_t i = 0; i < entry.descriptorCount; i++)
+        {
+            const auto info = static_cast<const uint8_t*>(data) + entry.offset + entry.stride * i;
+
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = entry.dstBinding;
+            write.dstArrayElement = entry.dstArrayElement + i;
+            write.descriptorType = entry.descriptorType;
+            write.descriptorCount = 1;
+
+            if (isBufferDescriptor(entry.descriptorType))
+                write.pBufferInfo = reinterpret_cast<const VkDescriptorBufferInfo*>(info);
+            else if (isTexelBufferDescriptor(entry.descriptorType))
+                write.pTexelBufferView = reinterpret_cast<const VkBufferView*>(info);
+            else
+                write.pImageInfo = reinterpret_cast<const VkDescriptorImageInfo*>(info);
+
+            writes.push_back(write);
+        }
+    }
+
+    vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
+}
@@ -6,17 +6,24 @@
 #pragma once
 
 #include "Vulkan.h"
+#include "VulkanExtensions.h"
 #include <vector>
 
 namespace vk
 {
+    class Device;
+
     class DescriptorSetUpdater
     {
     public:
         explicit DescriptorSetUpdater(VkDevice device);
 
         auto forUniformBuffer(uint32_t binding, VkDescriptorSet set, VkBuffer buffer,VkDeviceSize offset, VkDeviceSize range) -> DescriptorSetUpdater&;
+        auto forDynamicUniformBuffer(uint32_t binding, VkDescriptorSet set, VkBuffer buffer, VkDeviceSize range) -> DescriptorSetUpdater&;
         auto forTexture(uint32_t binding, VkDescriptorSet set, VkImageView view, VkSampler sampler, VkImageLayout layout) -> DescriptorSetUpdater&;
+        auto forStorageBuffer(uint32_t binding, VkDescriptorSet set, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) -> DescriptorSetUpdater&;
+        auto forDynamicStorageBuffer(uint32_t binding, VkDescriptorSet set, VkBuffer buffer, VkDeviceSize range) -> DescriptorSetUpdater&;
+        auto forStorageImage(uint32_t binding, VkDescriptorSet set, VkImageView view, VkImageLayout layout) -> DescriptorSetUpdater&;
 
         void updateSets();
 
@@ -25,6 +32,7 @@ namespace vk
         {
             VkDescriptorBufferInfo buffer;
             VkDescriptorImageInfo image;
+            VkDescriptorType type;
             uint32_t binding;
             VkDescriptorSet targetSet;
         };
@@ -32,4 +40,44 @@ namespace vk
         VkDevice device = nullptr;
         std::vector<Item> items;
     };
-}
\ No newline at end of file
+    // Describes where descriptors are in the structs a DescriptorUpdateTemplate is applied with. Offsets point at
+    // VkDescriptorBufferInfo, VkDescriptorImageInfo or VkBufferView members depending on the descriptor type.
+    class DescriptorUpdateTemplateConfig
+    {
+    public:
+        // Stride defaults to the size of the descriptor info, i.e. a tightly packed array
+        auto withEntry(uint32_t binding, VkDescriptorType type, size_t offset, uint32_t count = 1, size_t stride = 0) -> DescriptorUpdateTemplateConfig&;
+
+    private:
+        friend class DescriptorUpdateTemplate;
+
+        std::vector<VkDescriptorUpdateTemplateEntryKHR> entries;
+    };
+
+    // Writes all descriptors of a set from one packed struct in a single call, without building write structs
+    // per update. Uses VK_KHR_descriptor_update_template if the device has it and falls back to
+    // vkUpdateDescriptorSets otherwise. Not thread-safe.
+    class DescriptorUpdateTemplate
+    {
+    public:
+        DescriptorUpdateTemplate() {}
+        DescriptorUpdateTemplate(const Device &device, VkDescriptorSetLayout layout, const DescriptorUpdateTemplateConfig &config);
+        DescriptorUpdateTemplate(const DescriptorUpdateTemplate &other) = delete;
+        DescriptorUpdateTemplate(DescriptorUpdateTemplate &&other) = default;
+        ~DescriptorUpdateTemplate() {}
+
+        auto operator=(const DescriptorUpdateTemplate &other) -> DescriptorUpdateTemplate& = delete;
+        auto operator=(DescriptorUpdateTemplate &&other) -> DescriptorUpdateTemplate& = default;
+
+        void update(VkDescriptorSet set, const void *data) const;
+
+        auto isNative() const -> bool { return handle; }
+
+    private:
+        VkDevice device = nullptr;
+        PFN_vkUpdateDescriptorSetWithTemplateKHR updateWithTemplate = nullptr;
+        Resource<VkDescriptorUpdateTemplateKHR> handle;
+        std::vector<VkDescriptorUpdateTemplateEntryKHR> entries;
+        mutable std::vector<VkWriteDescriptorSet> writes; // reused by the fallback path
+    };
+}
@@ -4,7 +4,10 @@
 */
 
 #include "VulkanDevice.h"
+#include "../FileSystem.h"
 #include <vector>
+#include <cstring>
+#include <algorithm>
 #ifdef KL_WINDOWS
 #   include <windows.h>
 #endif
@@ -39,7 +42,15 @@ static auto getSurfaceFormats(VkPhysicalDevice device, VkSurfaceKHR surface) ->
     return {formats[0].format, formats[0].colorSpace};
 }
 
-static auto getQueueIndex(VkPhysicalDevice device, VkSurfaceKHR surface) -> uint32_t
+struct QueueFamilyIndices
+{
+    uint32_t graphics;
+    uint32_t present;
+    uint32_t compute;
+    uint32_t transfer;
+};
+
+static auto getQueueFamilyIndices(VkPhysicalDevice device, VkSurfaceKHR surface) -> QueueFamilyIndices
 {
     uint32_t count;
     vkGetPhysicalDeviceQueueFamilyProperties(device, &count, nullptr);
@@ -48,60 +59,116 @@ static auto getQueueIndex(VkPhysicalDevice device, VkSurfaceKHR surface) -> uint
     queueProps.resize(count);
     vkGetPhysicalDeviceQueueFamilyProperties(device, &count, queueProps.data());
 
-    std::vector<VkBool32> presentSupported(count);
-    for (uint32_t i = 0; i < count; i++)
-    KL_VK_CHECK_RESULT(vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupported[i]));
+    // Without a surface nothing is presented, any family will do
+    std::vector<VkBool32> presentSupported(count, VK_TRUE);
+    for (uint32_t i = 0; i < count && surface; i++)
+        KL_VK_CHECK_RESULT(vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupported[i]));
 
-    // TODO support for separate rendering and presenting queues
-    for (uint32_t i = 0; i < count; i++)
+    auto findFamily = [&](VkQueueFlags requiredFlags, VkQueueFlags excludedFlags, bool present)
     {
-        if (queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && presentSupported[i] == VK_TRUE)
-            return i;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const auto flags = queueProps[i].queueFlags;
+            if ((flags & requiredFlags) == requiredFlags && !(flags & excludedFlags) && (!present || presentSupported[i]))
+                return i;
+        }
+        return UINT32_MAX;
+    };
+
+    // Compute is recorded on the main queue as well, which is the case for graphics families on all practical
+    // implementations. Presenting from the same family saves sharing swapchain images between families.
+    const VkQueueFlags mainFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+    QueueFamilyIndices indices;
+    indices.graphics = findFamily(mainFlags, 0, true);
+    indices.present = indices.graphics;
+    if (indices.graphics == UINT32_MAX)
+    {
+        indices.graphics = findFamily(mainFlags, 0, false);
+        indices.present = findFamily(0, 0, true);
     }
+    KL_PANIC_IF(indices.graphics == UINT32_MAX || indices.present == UINT32_MAX, "Could not find queue index");
 
-    KL_PANIC("Could not find queue index");
-    return 0;
+    // Compute-only families run alongside rendering on hardware with async compute, transfer-only ones usually
+    // map to the copy engines. Both fall back to the main family.
+    indices.compute = findFamily(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT, false);
+    if (indices.compute == UINT32_MAX)
+        indices.compute = indices.graphics;
+    indices.transfer = findFamily(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT, false);
+    if (indices.transfer == UINT32_MAX)
+        indices.transfer = indices.graphics;
+
+    return indices;
 }
 
-static auto createDevice(VkPhysicalDevice physicalDevice, uint32_t queueIndex) -> vk::Resource<VkDevice>
+static bool isInstanceExtensionSupported(const char *name)
+{
+    uint32_t count;
+    KL_VK_CHECK_RESULT(vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr));
+
+    std::vector<VkExtensionProperties> extensions(count);
+    KL_VK_CHECK_RESULT(vkEnumerateInstanceExtensionProperties(nullptr, &count, extensions.data()));
+
+    for (const auto &extension: extensions)
+    {
+        if (!strcmp(extension.extensionName, name))
+            return true;
+    }
+
+    return false;
+}
+
+static bool isDeviceExtensionSupported(VkPhysicalDevice device, const char *name)
+{
+    uint32_t count;
+    KL_VK_CHECK_RESULT(vkEnumerateDeviceExtensionProperties(device, nullptr, &count, nullptr));
+
+    std::vector<VkExtensionProperties> extensions(count);
+    KL_VK_CHECK_RESULT(vkEnumerateDeviceExtensionProperties(device, nullptr, &count, extensions.data()));
+
+    for (const auto &extension: extensions)
+    {
+        if (!strcmp(extension.extensionName, name))
+            return true;
+    }
+
+    return false;
+}
+
+static auto createDevice(VkPhysicalDevice physicalDevice, const QueueFamilyIndices &queueIndices,
+    const std::vector<const char*> &extensions, const VkPhysicalDeviceFeatures &enabledFeatures,
+    void *enabledExtensionFeatures) -> vk::Resource<VkDevice>
 {
     std::vector<float> queuePriorities = {0.0f};
-    VkDeviceQueueCreateInfo queueCreateInfo{};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = queueIndex;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = queuePriorities.data();
-
-    std::vector<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    for (auto index: {queueIndices.graphics, queueIndices.present, queueIndices.compute, queueIndices.transfer})
+    {
+        const auto created = std::any_of(queueCreateInfos.begin(), queueCreateInfos.end(),
+            [index](const VkDeviceQueueCreateInfo &info) { return info.queueFamilyIndex == index; });
+        if (created)
+            continue;
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = index;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = queuePriorities.data();
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
 
     VkDeviceCreateInfo deviceCreateInfo{};
-    std::vector<VkPhysicalDeviceFeatures> enabledFeatures{};
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.queueCreateInfoCount = 1;
-    deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-    deviceCreateInfo.pEnabledFeatures = enabledFeatures.data();
-    deviceCreateInfo.enabledExtensionCount = deviceExtensions.size();
-    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    deviceCreateInfo.pNext = enabledExtensionFeatures;
+    deviceCreateInfo.queueCreateInfoCount = queueCreateInfos.size();
+    deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
+    deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
+    deviceCreateInfo.enabledExtensionCount = extensions.size();
+    deviceCreateInfo.ppEnabledExtensionNames = extensions.data();
 
-    vk::Resource<VkDevice> result{vkDestroyDevice};
+    vk::Resource<VkDevice> result;
     KL_VK_CHECK_RESULT(vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, result.cleanRef()));
 
     return result;
 }
 
-static auto createCommandPool(VkDevice device, uint32_t queueIndex) -> vk::Resource<VkCommandPool>
-{
-    VkCommandPoolCreateInfo poolInfo{};
-    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = queueIndex;
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-
-    vk::Resource<VkCommandPool> commandPool{device, vkDestroyCommandPool};
-    KL_VK_CHECK_RESULT(vkCreateCommandPool(device, &poolInfo, nullptr, commandPool.cleanRef()));
-
-    return commandPool;
-}
-
 static auto getDepthFormat(VkPhysicalDevice device) -> VkFormat
 {
     std::vector<VkFormat> depthFormats =
@@ -125,7 +192,52 @@ static auto getDepthFormat(VkPhysicalDevice device) -> VkFormat
     return VK_FORMAT_UNDEFINED;
 }
 
-auto vk::Device::create(const std::vector<uint8_t> &platformHandle) -> Device
+// Checks the header written by the driver in front of the cache blob (see VkPipelineCacheHeaderVersion),
+// so that data produced by another GPU or driver version is never fed back into vkCreatePipelineCache
+static bool isPipelineCacheCompatible(const std::vector<uint8_t> &data, const VkPhysicalDeviceProperties &props)
+{
+    struct
+    {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorId;
+        uint32_t deviceId;
+        uint8_t uuid[VK_UUID_SIZE];
+    } header;
+
+    if (data.size() < sizeof(header))
+        return false;
+
+    memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header) &&
+        header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header.vendorId == props.vendorID &&
+        header.deviceId == props.deviceID &&
+        memcmp(header.uuid, props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static auto createPipelineCache(VkDevice device, const std::vector<uint8_t> &initialData) -> vk::Resource<VkPipelineCache>
+{
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.pNext = nullptr;
+    cacheInfo.flags = 0;
+    cacheInfo.initialDataSize = initialData.size();
+    cacheInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+    vk::Resource<VkPipelineCache> cache{device};
+    KL_VK_CHECK_RESULT(vkCreatePipelineCache(device, &cacheInfo, nullptr, cache.cleanRef()));
+
+    return cache;
+}
+
+auto vk::Device::createHeadless(const std::string &pipelineCachePath) -> Device
+{
+    return create({}, pipelineCachePath);
+}
+
+auto vk::Device::create(const std::vector<uint8_t> &platformHandle, const std::string &pipelineCachePath) -> Device
 {
     VkApplicationInfo appInfo {};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -133,15 +245,28 @@ auto vk::Device::create(const std::vector<uint8_t> &platformHandle) -> Device
     appInfo.pEngineName = "";
     appInfo.apiVersion = VK_API_VERSION_1_0;
 
-    std::vector<const char*> enabledExtensions {
-        VK_KHR_SURFACE_EXTENSION_NAME,
-#ifdef KL_WINDOWS
-        VK_KHR_WIN32_SURFACE_EXTENSION_NAME,
+    const auto headless = platformHandle.empty();
+#ifndef KL_WINDOWS
+    KL_PANIC_IF(!headless, "Surfaces are only supported on Windows");
 #endif
+
+    std::vector<const char*> enabledExtensions {
 #ifdef KL_DEBUG
         VK_EXT_DEBUG_REPORT_EXTENSION_NAME
 #endif
     };
+    if (!headless)
+    {
+        enabledExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+#ifdef KL_WINDOWS
+        enabledExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+#endif
+    }
+
+    // Needed to query features of device extensions
+    const auto physicalDeviceProperties2 = isInstanceExtensionSupported(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    if (physicalDeviceProperties2)
+        enabledExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
     std::vector<const char *> enabledLayers {
 #ifdef KL_DEBUG
@@ -166,27 +291,31 @@ auto vk::Device::create(const std::vector<uint8_t> &platformHandle) -> Device
         instanceInfo.ppEnabledExtensionNames = enabledExtensions.data();
     }
 
-    Resource<VkInstance> instance{vkDestroyInstance};
+    Resource<VkInstance> instance;
     KL_VK_CHECK_RESULT(vkCreateInstance(&instanceInfo, nullptr, instance.cleanRef()));
 
+    Resource<VkSurfaceKHR> surface;
 #ifdef KL_WINDOWS
-    struct
+    if (!headless)
     {
-        HWND hWnd;
-        HINSTANCE hInst;
-    } handle;
+        struct
+        {
+            HWND hWnd;
+            HINSTANCE hInst;
+        } handle;
 
-    memcpy(&handle, platformHandle.data(), sizeof(handle));
+        memcpy(&handle, platformHandle.data(), sizeof(handle));
 
-    VkWin32SurfaceCreateInfoKHR surfaceInfo;
-    surfaceInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-    surfaceInfo.flags = 0;
-    surfaceInfo.pNext = nullptr;
-    surfaceInfo.hinstance = handle.hInst;
-    surfaceInfo.hwnd = handle.hWnd;
+        VkWin32SurfaceCreateInfoKHR surfaceInfo;
+        surfaceInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+        surfaceInfo.flags = 0;
+        surfaceInfo.pNext = nullptr;
+        surfaceInfo.hinstance = handle.hInst;
+        surfaceInfo.hwnd = handle.hWnd;
 
-    Resource<VkSurfaceKHR> surface{instance, vkDestroySurfaceKHR};
-    KL_VK_CHECK_RESULT(vkCreateWin32SurfaceKHR(instance, &surfaceInfo, nullptr, surface.cleanRef()));
+        surface = Resource<VkSurfaceKHR>{instance};
+        KL_VK_CHECK_RESULT(vkCreateWin32SurfaceKHR(instance, &surfaceInfo, nullptr, surface.cleanRef()));
+    }
 #endif
 
     Device device{};
@@ -200,16 +329,135 @@ auto vk::Device::create(const std::vector<uint8_t> &platformHandle) -> Device
     vkGetPhysicalDeviceFeatures(device.physicalDevice, &device.physicalFeatures);
     vkGetPhysicalDeviceMemoryProperties(device.physicalDevice, &device.physicalMemoryFeatures);
 
-    auto surfaceFormats = getSurfaceFormats(device.physicalDevice, device.surface);
-    device.colorFormat = std::get<0>(surfaceFormats);
-    device.colorSpace = std::get<1>(surfaceFormats);
+    if (device.surface)
+    {
+        auto surfaceFormats = getSurfaceFormats(device.physicalDevice, device.surface);
+        device.colorFormat = std::get<0>(surfaceFormats);
+        device.colorSpace = std::get<1>(surfaceFormats);
+    }
+    else
+    {
+        device.colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        device.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    }
     device.depthFormat = ::getDepthFormat(device.physicalDevice);
 
-	const auto queueIndex = getQueueIndex(device.physicalDevice, device.surface);
-    device.device = createDevice(device.physicalDevice, queueIndex);
+    const auto queueIndices = getQueueFamilyIndices(device.physicalDevice, device.surface);
+    const auto queueIndex = queueIndices.graphics;
+    const auto transferQueueIndex = queueIndices.transfer;
+
+    std::vector<const char*> optionalExtensions;
+    if (device.surface)
+        optionalExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    device.extensions.descriptorUpdateTemplate = isDeviceExtensionSupported(device.physicalDevice, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+    if (device.extensions.descriptorUpdateTemplate)
+        optionalExtensions.push_back(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures{};
+    descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    if (physicalDeviceProperties2 &&
+        isDeviceExtensionSupported(device.physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+        isDeviceExtensionSupported(device.physicalDevice, VK_KHR_MAINTENANCE3_EXTENSION_NAME))
+    {
+        auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+            vkGetInstanceProcAddr(device.instance, "vkGetPhysicalDeviceFeatures2KHR"));
+
+        VkPhysicalDeviceFeatures2KHR features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+        features.pNext = &descriptorIndexingFeatures;
+        getFeatures2(device.physicalDevice, &features);
+
+        // Texture indices come from push constants, so they are dynamically uniform and non-uniform indexing is
+        // not needed
+        device.extensions.descriptorIndexing =
+            device.physicalFeatures.shaderSampledImageArrayDynamicIndexing &&
+            descriptorIndexingFeatures.runtimeDescriptorArray &&
+            descriptorIndexingFeatures.descriptorBindingPartiallyBound &&
+            descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+    }
+
+    void *enabledExtensionFeatures = nullptr;
+    if (device.extensions.descriptorIndexing)
+    {
+        optionalExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+        optionalExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+
+        // Only what the texture table relies on
+        descriptorIndexingFeatures = {};
+        descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        enabledExtensionFeatures = &descriptorIndexingFeatures;
+        device.enabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+    }
+
+    // For profiling, otherwise core functionality is enough
+    device.enabledFeatures.pipelineStatisticsQuery = device.physicalFeatures.pipelineStatisticsQuery;
+
+    device.device = createDevice(device.physicalDevice, queueIndices, optionalExtensions, device.enabledFeatures,
+        enabledExtensionFeatures);
+
+    if (device.extensions.descriptorUpdateTemplate)
+    {
+        device.extensions.createDescriptorUpdateTemplate = reinterpret_cast<PFN_vkCreateDescriptorUpdateTemplateKHR>(
+            vkGetDeviceProcAddr(device, "vkCreateDescriptorUpdateTemplateKHR"));
+        device.extensions.updateDescriptorSetWithTemplate = reinterpret_cast<PFN_vkUpdateDescriptorSetWithTemplateKHR>(
+            vkGetDeviceProcAddr(device, "vkUpdateDescriptorSetWithTemplateKHR"));
+    }
+
     vkGetDeviceQueue(device, queueIndex, 0, &device.queue);
+    vkGetDeviceQueue(device, queueIndices.present, 0, &device.presentQueue);
+    vkGetDeviceQueue(device, queueIndices.compute, 0, &device.computeQueue);
+    vkGetDeviceQueue(device, transferQueueIndex, 0, &device.transferQueue);
+    device.queueIndex = queueIndex;
+    device.presentQueueIndex = queueIndices.present;
+    device.computeQueueIndex = queueIndices.compute;
+    device.transferQueueIndex = transferQueueIndex;
+    device.memoryAllocator = std::make_unique<MemoryAllocator>(device, device.physicalMemoryFeatures);
+    device.uploadQueue = std::make_unique<UploadQueue>(device, *device.memoryAllocator,
+        device.queue, queueIndex, device.transferQueue, transferQueueIndex,
+        device.physicalProperties.limits.optimalBufferCopyOffsetAlignment);
+
+    device.commandPool = createCommandPool(device, queueIndex, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    device.deletionQueue = std::make_unique<DeletionQueue>();
+
+    std::vector<uint8_t> pipelineCacheData;
+    if (fs::exists(pipelineCachePath))
+    {
+        pipelineCacheData = fs::readBytes(pipelineCachePath);
+        if (!isPipelineCacheCompatible(pipelineCacheData, device.physicalProperties))
+            pipelineCacheData.clear();
+    }
 
-    device.commandPool = createCommandPool(device, queueIndex);
+    device.pipelineCache = createPipelineCache(device, pipelineCacheData);
+    device.pipelineCachePath = pipelineCachePath;
+    device.pipelineCacheStats.warm = !pipelineCacheData.empty();
+    device.pipelineCacheStatsMutex = std::make_unique<std::mutex>();
 
     return device;
 }
+
+auto vk::Device::getPipelineCacheStats() const -> PipelineCacheStats
+{
+    std::lock_guard<std::mutex> lock(*pipelineCacheStatsMutex);
+    return pipelineCacheStats;
+}
+
+void vk::Device::notifyPipelineCreated(double timeMs) const
+{
+    std::lock_guard<std::mutex> lock(*pipelineCacheStatsMutex);
+    pipelineCacheStats.pipelineCount++;
+    pipelineCacheStats.creationTimeMs += timeMs;
+}
+
+void vk::Device::savePipelineCache() const
+{
+    size_t size = 0;
+    KL_VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
+
+    std::vector<uint8_t> data(size);
+    KL_VK_CHECK_RESULT(vkGetPipelineCacheData(device, pipelineCache, &size, data.data()));
+
+    fs::writeBytes(pipelineCachePath, data.data(), size);
+}
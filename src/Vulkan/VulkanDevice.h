@@ -6,26 +6,59 @@
 #pragma once
 
 #include "Vulkan.h"
+#include "VulkanExtensions.h"
+#include "VulkanMemoryAllocator.h"
+#include "VulkanUploadQueue.h"
+#include "VulkanDeletionQueue.h"
 #include <vector>
+#include <string>
+#include <mutex>
 
 namespace vk
 {
+    struct PipelineCacheStats
+    {
+        bool warm = false; // whether the cache was restored from disk
+        uint32_t pipelineCount = 0;
+        double creationTimeMs = 0;
+    };
+
     class Device
     {
     public:
-        static auto create(const std::vector<uint8_t> &platformHandle) -> Device;
+        static auto create(const std::vector<uint8_t> &platformHandle, const std::string &pipelineCachePath) -> Device;
+        // No surface and no swapchain support, for rendering offscreen only. Works with software implementations.
+        static auto createHeadless(const std::string &pipelineCachePath) -> Device;
 
         auto getInstance() const -> VkInstance { return instance; }
-        auto getSurface() const -> VkSurfaceKHR { return surface; }
+        auto getSurface() const -> VkSurfaceKHR { return surface; } // null if headless
+        auto isHeadless() const -> bool { return !surface; }
         auto getPhysicalDevice() const -> VkPhysicalDevice { return physicalDevice; }
         auto getPhysicalFeatures() const -> VkPhysicalDeviceFeatures { return physicalFeatures; }
+        auto getEnabledFeatures() const -> VkPhysicalDeviceFeatures { return enabledFeatures; }
         auto getPhysicalProperties() const -> VkPhysicalDeviceProperties { return physicalProperties; }
         auto getPhysicalMemoryFeatures() const -> VkPhysicalDeviceMemoryProperties { return physicalMemoryFeatures; }
+        auto getExtensions() const -> const DeviceExtensions& { return extensions; }
         auto getColorFormat() const -> VkFormat { return colorFormat; }
         auto getDepthFormat() const -> VkFormat { return depthFormat; }
         auto getColorSpace() const -> VkColorSpaceKHR { return colorSpace; }
         auto getCommandPool() const -> VkCommandPool { return commandPool; }
-        auto getQueue() const -> VkQueue { return queue; }
+        auto getQueue() const -> VkQueue { return queue; } // graphics and compute
+        auto getQueueIndex() const -> uint32_t { return queueIndex; }
+        auto getPresentQueue() const -> VkQueue { return presentQueue; } // same as the main queue if its family can present
+        auto getPresentQueueIndex() const -> uint32_t { return presentQueueIndex; }
+        auto getComputeQueue() const -> VkQueue { return computeQueue; } // same as the main queue if there's no compute-only family
+        auto getComputeQueueIndex() const -> uint32_t { return computeQueueIndex; }
+        auto getTransferQueue() const -> VkQueue { return transferQueue; } // same as the main queue if there's no transfer-only family
+        auto getTransferQueueIndex() const -> uint32_t { return transferQueueIndex; }
+        auto getPipelineCache() const -> VkPipelineCache { return pipelineCache; }
+        auto getPipelineCacheStats() const -> PipelineCacheStats;
+        auto getMemoryAllocator() const -> MemoryAllocator& { return *memoryAllocator; }
+        auto getUploadQueue() const -> UploadQueue& { return *uploadQueue; }
+        auto getDeletionQueue() const -> DeletionQueue& { return *deletionQueue; }
+
+        void notifyPipelineCreated(double timeMs) const;
+        void savePipelineCache() const;
 
         operator VkDevice() { return device; }
         operator VkDevice() const { return device; }
@@ -35,15 +68,31 @@ namespace vk
         Resource<VkSurfaceKHR> surface;
         Resource<VkDebugReportCallbackEXT> debugCallback;
         Resource<VkDevice> device;
+        uptr<MemoryAllocator> memoryAllocator; // after the device so that it's destroyed first
+        uptr<UploadQueue> uploadQueue; // holds staging memory, so destroyed before the allocator
         Resource<VkCommandPool> commandPool;
+        Resource<VkPipelineCache> pipelineCache;
+        uptr<DeletionQueue> deletionQueue; // destroyed before everything it may hold objects of
+        std::string pipelineCachePath;
+        mutable PipelineCacheStats pipelineCacheStats;
+        uptr<std::mutex> pipelineCacheStatsMutex; // pipelines can be created from worker threads
         VkPhysicalDevice physicalDevice = nullptr;
         VkPhysicalDeviceFeatures physicalFeatures{};
+        VkPhysicalDeviceFeatures enabledFeatures{};
         VkPhysicalDeviceProperties physicalProperties{};
         VkPhysicalDeviceMemoryProperties physicalMemoryFeatures{};
+        DeviceExtensions extensions;
         VkFormat colorFormat = VK_FORMAT_UNDEFINED;
         VkFormat depthFormat = VK_FORMAT_UNDEFINED;
         VkColorSpaceKHR colorSpace = VK_COLOR_SPACE_MAX_ENUM_KHR;
         VkQueue queue = nullptr;
+        VkQueue presentQueue = nullptr;
+        VkQueue computeQueue = nullptr;
+        VkQueue transferQueue = nullptr;
+        uint32_t queueIndex = 0;
+        uint32_t presentQueueIndex = 0;
+        uint32_t computeQueueIndex = 0;
+        uint32_t transferQueueIndex = 0;
 
         Device() {}
     };
@@ -0,0 +1,206 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanGpuProfiler.h"
+#include "VulkanDevice.h"
+#include <algorithm>
+
+// Results are written in the order of the bits
+static const VkQueryPipelineStatisticFlags statisticFlags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+static auto createQueryPool(VkDevice device, VkQueryType type, uint32_t count,
+    VkQueryPipelineStatisticFlags statistics) -> vk::Resource<VkQueryPool>
+{
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = type;
+    poolInfo.queryCount = count;
+    poolInfo.pipelineStatistics = statistics;
+
+    vk::Resource<VkQueryPool> pool{device};
+    KL_VK_CHECK_RESULT(vkCreateQueryPool(device, &poolInfo, nullptr, pool.cleanRef()));
+
+    return pool;
+}
+
+// Sorted values
+static auto getPercentile(const std::vector<double> &values, double percentile) -> double
+{
+    const auto index = static_cast<size_t>(percentile * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+vk::GpuProfiler::GpuProfiler(const Device &device, uint32_t frameCount, uint32_t maxScopes, uint32_t historySize):
+    device(device),
+    maxScopes(maxScopes),
+    historySize(historySize),
+    slots(frameCount)
+{
+    uint32_t familyCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device.getPhysicalDevice(), &familyCount, families.data());
+
+    const auto validBits = families[device.getQueueIndex()].timestampValidBits;
+    enabled = validBits > 0;
+    statisticsEnabled = enabled && device.getEnabledFeatures().pipelineStatisticsQuery;
+    timestampMask = validBits >= 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+    timestampPeriod = device.getPhysicalProperties().limits.timestampPeriod;
+
+    if (!enabled)
+        return;
+
+    for (auto &slot: slots)
+    {
+        slot.timestampPool = createQueryPool(device, VK_QUERY_TYPE_TIMESTAMP, maxScopes * 2, 0);
+        if (statisticsEnabled)
+            slot.statisticsPool = createQueryPool(device, VK_QUERY_TYPE_PIPELINE_STATISTICS, maxScopes, statisticFlags);
+    }
+}
+
+auto vk::GpuProfiler::addScope(const std::string &name, bool pipelineStatistics) -> uint32_t
+{
+    KL_PANIC_IF(scopes.size() == maxScopes, "Too many profiler scopes");
+
+    Scope scope;
+    scope.name = name;
+    scope.pipelineStatistics = pipelineStatistics && statisticsEnabled;
+    scope.history.resize(historySize);
+    scopes.push_back(std::move(scope));
+
+    return static_cast<uint32_t>(scopes.size() - 1);
+}
+
+void vk::GpuProfiler::beginFrame(VkCommandBuffer buf, uint32_t frameIndex)
+{
+    if (!enabled)
+        return;
+
+    auto &slot = slots[frameIndex];
+    if (slot.submitted)
+        collect(slot);
+
+    vkCmdResetQueryPool(buf, slot.timestampPool, 0, maxScopes * 2);
+    if (statisticsEnabled)
+        vkCmdResetQueryPool(buf, slot.statisticsPool, 0, maxScopes);
+    slot.submitted = true;
+}
+
+void vk::GpuProfiler::beginScope(VkCommandBuffer buf, uint32_t frameIndex, uint32_t scope, VkPipelineStageFlagBits stage) const
+{
+    if (!enabled)
+        return;
+
+    const auto &slot = slots[frameIndex];
+    vkCmdWriteTimestamp(buf, stage, slot.timestampPool, scope * 2);
+    if (scopes[scope].pipelineStatistics)
+        vkCmdBeginQuery(buf, slot.statisticsPool, scope, 0);
+}
+
+void vk::GpuProfiler::endScope(VkCommandBuffer buf, uint32_t frameIndex, uint32_t scope) const
+{
+    if (!enabled)
+        return;
+
+    const auto &slot = slots[frameIndex];
+    if (scopes[scope].pipelineStatistics)
+        vkCmdEndQuery(buf, slot.statisticsPool, scope);
+    vkCmdWriteTimestamp(buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot.timestampPool, scope * 2 + 1);
+}
+
+void vk::GpuProfiler::collect(FrameSlot &slot)
+{
+    const auto scopeCount = static_cast<uint32_t>(scopes.size());
+    if (!scopeCount)
+        return;
+
+    // Each result is followed by its availability, not ready is expected for scopes not recorded in the frame
+    std::vector<uint64_t> timestamps(scopeCount * 2 * 2);
+    const auto flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+    const auto timestampsResult = vkGetQueryPoolResults(device, slot.timestampPool, 0, scopeCount * 2,
+        timestamps.size() * sizeof(uint64_t), timestamps.data(), 2 * sizeof(uint64_t), flags);
+    if (timestampsResult != VK_SUCCESS && timestampsResult != VK_NOT_READY)
+        KL_PANIC("Failed to get timestamps");
+
+    const auto statisticsStride = statisticCount + 1;
+    std::vector<uint64_t> statistics;
+    if (statisticsEnabled)
+    {
+        statistics.resize(scopeCount * statisticsStride);
+        const auto statisticsResult = vkGetQueryPoolResults(device, slot.statisticsPool, 0, scopeCount,
+            statistics.size() * sizeof(uint64_t), statistics.data(), statisticsStride * sizeof(uint64_t), flags);
+        if (statisticsResult != VK_SUCCESS && statisticsResult != VK_NOT_READY)
+            KL_PANIC("Failed to get pipeline statistics");
+    }
+
+    for (uint32_t i = 0; i < scopeCount; i++)
+    {
+        const auto begin = &timestamps[i * 4];
+        const auto end = &timestamps[i * 4 + 2];
+        if (!begin[1] || !end[1])
+            continue;
+
+        auto &scope = scopes[i];
+        auto &sample = scope.history[scope.next];
+        sample.ms = ((end[0] - begin[0]) & timestampMask) * timestampPeriod / 1000000.0;
+
+        const auto stats = scope.pipelineStatistics ? &statistics[i * statisticsStride] : nullptr;
+        sample.hasStatistics = stats && stats[statisticCount];
+        for (uint32_t s = 0; s < statisticCount; s++)
+            sample.statistics[s] = sample.hasStatistics ? stats[s] : 0;
+
+        scope.next = (scope.next + 1) % historySize;
+        scope.sampleCount = (std::min)(scope.sampleCount + 1, historySize);
+    }
+}
+
+auto vk::GpuProfiler::getScopeStats(uint32_t scope) const -> GpuScopeStats
+{
+    const auto &s = scopes[scope];
+
+    GpuScopeStats stats;
+    stats.sampleCount = s.sampleCount;
+    if (!s.sampleCount)
+        return stats;
+
+    std::vector<double> times;
+    double statistics[statisticCount]{};
+    for (uint32_t i = 0; i < s.sampleCount; i++)
+    {
+        const auto &sample = s.history[i];
+        times.push_back(sample.ms);
+        if (!sample.hasStatistics)
+            continue;
+        stats.statisticsSampleCount++;
+        for (uint32_t j = 0; j < statisticCount; j++)
+            statistics[j] += sample.statistics[j];
+    }
+    std::sort(times.begin(), times.end());
+
+    double total = 0;
+    for (const auto time: times)
+        total += time;
+
+    stats.averageMs = total / s.sampleCount;
+    stats.medianMs = getPercentile(times, 0.5);
+    stats.p95Ms = getPercentile(times, 0.95);
+    stats.p99Ms = getPercentile(times, 0.99);
+    stats.maxMs = times.back();
+    if (!stats.statisticsSampleCount)
+        return stats;
+
+    stats.inputAssemblyVertices = statistics[0] / stats.statisticsSampleCount;
+    stats.inputAssemblyPrimitives = statistics[1] / stats.statisticsSampleCount;
+    stats.vertexShaderInvocations = statistics[2] / stats.statisticsSampleCount;
+    stats.clippingPrimitives = statistics[3] / stats.statisticsSampleCount;
+    stats.fragmentShaderInvocations = statistics[4] / stats.statisticsSampleCount;
+
+    return stats;
+}
@@ -0,0 +1,106 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include <vector>
+#include <string>
+
+namespace vk
+{
+    class Device;
+
+    struct GpuScopeStats
+    {
+        uint32_t sampleCount = 0; // frames in the window
+        uint32_t statisticsSampleCount = 0; // of them, frames with pipeline statistics available
+        double averageMs = 0;
+        double medianMs = 0;
+        double p95Ms = 0;
+        double p99Ms = 0;
+        double maxMs = 0;
+        // Averages per frame with statistics available, zero for scopes without pipeline statistics
+        double inputAssemblyVertices = 0;
+        double inputAssemblyPrimitives = 0;
+        double vertexShaderInvocations = 0;
+        double clippingPrimitives = 0;
+        double fragmentShaderInvocations = 0;
+    };
+
+    // Measures GPU time of named scopes with timestamps, and optionally what the draws in them did with pipeline
+    // statistics queries. Each frame slot has its own query pools. Results of a slot are read back without waiting
+    // when the slot is reused, i.e. once its previous frame is known to be complete, and kept for the last
+    // historySize frames. A scope can be recorded at most once per frame, scopes without results in a frame are left
+    // out of their stats. Scopes with statistics must not overlap each other within a command buffer, nor contain
+    // vkCmdExecuteCommands. Does nothing where the main queue has no timestamps.
+    // Scopes can be recorded from several threads, everything else is not thread-safe.
+    class GpuProfiler
+    {
+    public:
+        GpuProfiler() {}
+        GpuProfiler(const Device &device, uint32_t frameCount, uint32_t maxScopes, uint32_t historySize = 256);
+        GpuProfiler(const GpuProfiler &other) = delete;
+        GpuProfiler(GpuProfiler &&other) = default;
+        ~GpuProfiler() {}
+
+        auto operator=(const GpuProfiler &other) -> GpuProfiler& = delete;
+        auto operator=(GpuProfiler &&other) -> GpuProfiler& = default;
+
+        // Pipeline statistics are collected only if the device has them enabled
+        auto addScope(const std::string &name, bool pipelineStatistics = false) -> uint32_t;
+
+        // Collects the results of the slot's previous frame and records resetting its queries. The buffer must be
+        // submitted before any other work of the frame that records scopes.
+        void beginFrame(VkCommandBuffer buf, uint32_t frameIndex);
+        // Work waiting on a semaphore can start the scope at the stage it waits at, so that the wait isn't timed
+        void beginScope(VkCommandBuffer buf, uint32_t frameIndex, uint32_t scope,
+            VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT) const;
+        void endScope(VkCommandBuffer buf, uint32_t frameIndex, uint32_t scope) const;
+
+        auto isEnabled() const -> bool { return enabled; }
+        auto getScopeCount() const -> uint32_t { return scopes.size(); }
+        auto getScopeName(uint32_t scope) const -> const std::string& { return scopes[scope].name; }
+        auto getScopeStats(uint32_t scope) const -> GpuScopeStats;
+
+    private:
+        static const uint32_t statisticCount = 5;
+
+        struct Sample
+        {
+            double ms;
+            bool hasStatistics;
+            uint64_t statistics[statisticCount];
+        };
+
+        struct Scope
+        {
+            std::string name;
+            bool pipelineStatistics;
+            std::vector<Sample> history; // ring
+            uint32_t next = 0;
+            uint32_t sampleCount = 0;
+        };
+
+        struct FrameSlot
+        {
+            Resource<VkQueryPool> timestampPool; // begin and end of each scope
+            Resource<VkQueryPool> statisticsPool;
+            bool submitted = false;
+        };
+
+        VkDevice device = nullptr;
+        bool enabled = false;
+        bool statisticsEnabled = false;
+        uint32_t maxScopes = 0;
+        uint32_t historySize = 0;
+        uint64_t timestampMask = 0;
+        double timestampPeriod = 0; // ns per tick
+        std::vector<FrameSlot> slots;
+        std::vector<Scope> scopes;
+
+        void collect(FrameSlot &slot);
+    };
+}
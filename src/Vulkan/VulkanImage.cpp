@@ -21,6 +21,20 @@ static auto toVulkanFormat(ImageData::Format format) -> VkFormat
     }
 }
 
+static auto getTexelSize(ImageData::Format format) -> VkDeviceSize
+{
+    switch (format)
+    {
+        case ImageData::Format::R8_UNORM:
+            return 1;
+        case ImageData::Format::R8G8B8A8_UNORM:
+            return 4;
+        default:
+            KL_PANIC("Unsupported texture format");
+            return 1;
+    }
+}
+
 static auto createImage(VkDevice device, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels,
     uint32_t arrayLayers, VkImageCreateFlags createFlags, VkImageUsageFlags usageFlags) -> vk::Resource<VkImage>
 {
@@ -38,7 +52,7 @@ static auto createImage(VkDevice device, VkFormat format, uint32_t width, uint32
     imageCreateInfo.usage = usageFlags;
     imageCreateInfo.flags = createFlags;
 
-    vk::Resource<VkImage> image{device, vkDestroyImage};
+    vk::Resource<VkImage> image{device};
     KL_VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, image.cleanRef()));
 
     return image;
@@ -69,131 +83,21 @@ static auto createSampler(VkDevice device, VkPhysicalDeviceFeatures physicalFeat
         samplerInfo.anisotropyEnable = VK_TRUE;
     }
 
-    vk::Resource<VkSampler> sampler{device, vkDestroySampler};
+    vk::Resource<VkSampler> sampler{device};
     KL_VK_CHECK_RESULT(vkCreateSampler(device, &samplerInfo, nullptr, sampler.cleanRef()));
 
     return sampler;
 }
 
-static void setImageLayout(VkCommandBuffer cmdbuffer, VkImage image, VkImageLayout oldImageLayout, VkImageLayout newImageLayout,
-    VkImageSubresourceRange subresourceRange, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask)
-{
-    VkImageMemoryBarrier imageMemoryBarrier{};
-	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.oldLayout = oldImageLayout;
-    imageMemoryBarrier.newLayout = newImageLayout;
-    imageMemoryBarrier.image = image;
-    imageMemoryBarrier.subresourceRange = subresourceRange;
-
-    // Source layouts (old)
-    // Source access mask controls actions that have to be finished on the old layout
-    // before it will be transitioned to the new layout
-    switch (oldImageLayout)
-    {
-        case VK_IMAGE_LAYOUT_UNDEFINED:
-            // Image layout is undefined (or does not matter)
-            // Only valid as initial layout
-            // No flags required, listed only for completeness
-            imageMemoryBarrier.srcAccessMask = 0;
-            break;
-
-        case VK_IMAGE_LAYOUT_PREINITIALIZED:
-            // Image is preinitialized
-            // Only valid as initial layout for linear images, preserves memory contents
-            // Make sure host writes have been finished
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-            // Image is a color attachment
-            // Make sure any writes to the color buffer have been finished
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-            // Image is a depth/stencil attachment
-            // Make sure any writes to the depth/stencil buffer have been finished
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-            // Image is a transfer source 
-            // Make sure any reads from the image have been finished
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-            // Image is a transfer destination
-            // Make sure any writes to the image have been finished
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-            // Image is read by a shader
-            // Make sure any shader reads from the image have been finished
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            break;
-        default:
-            break;
-    }
-
-    // Target layouts (new)
-    // Destination access mask controls the dependency for the new image layout
-    switch (newImageLayout)
-    {
-        case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-            // Image will be used as a transfer destination
-            // Make sure any writes to the image have been finished
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-            // Image will be used as a transfer source
-            // Make sure any reads from the image have been finished
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
-            // Image will be used as a color attachment
-            // Make sure any writes to the color buffer have been finished
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
-            // Image layout will be used as a depth/stencil attachment
-            // Make sure any writes to depth/stencil buffer have been finished
-            imageMemoryBarrier.dstAccessMask = imageMemoryBarrier.dstAccessMask | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-            break;
-
-        case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-            // Image will be read in a shader (sampler, input attachment)
-            // Make sure any writes to the image have been finished
-            if (imageMemoryBarrier.srcAccessMask == 0)
-                imageMemoryBarrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            break;
-        default:
-            break;
-    }
-
-    vkCmdPipelineBarrier(cmdbuffer, srcStageMask, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-}
-
-static auto allocateImageMemory(VkDevice device, VkPhysicalDeviceMemoryProperties memProps, VkImage image) -> vk::Resource<VkDeviceMemory>
+static auto allocateImageMemory(const vk::Device &device, VkImage image, VkImageUsageFlags usageFlags) -> vk::Allocation
 {
     VkMemoryRequirements memReqs{};
     vkGetImageMemoryRequirements(device, image, &memReqs);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReqs.size;
-    allocInfo.memoryTypeIndex = vk::findMemoryType(memProps, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    vk::Resource<VkDeviceMemory> memory{device, vkFreeMemory};
-    KL_VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, memory.cleanRef()));
-    KL_VK_CHECK_RESULT(vkBindImageMemory(device, image, memory, 0));
+    // Render targets get their own memory, drivers may place those in faster memory and they don't come and go anyway
+    const auto dedicated = (usageFlags & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
+    auto memory = device.getMemoryAllocator().allocate(memReqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, dedicated);
+    KL_VK_CHECK_RESULT(vkBindImageMemory(device, image, memory.getMemory(), memory.getOffset()));
 
     return memory;
 }
@@ -234,6 +138,7 @@ auto vk::Image::createCube(const Device &device, const ImageData &data) -> Image
 
 vk::Image::Image(const Device &device, uint32_t width, uint32_t height, uint32_t mipLevels, uint32_t layers, VkFormat format,
     VkImageCreateFlags createFlags, VkImageUsageFlags usageFlags, VkImageViewType viewType, VkImageAspectFlags aspectMask):
+    deletionQueue(&device.getDeletionQueue()),
     mipLevels(mipLevels),
     layers(layers),
     aspectMask(aspectMask),
@@ -241,7 +146,7 @@ vk::Image::Image(const Device &device, uint32_t width, uint32_t height, uint32_t
     height(height)
 {
     auto image = createImage(device, format, width, height, mipLevels, layers, createFlags, usageFlags);
-    auto memory = allocateImageMemory(device, device.getPhysicalMemoryFeatures(), image);
+    auto memory = allocateImageMemory(device, image, usageFlags);
     auto sampler = createSampler(device, device.getPhysicalFeatures(), device.getPhysicalProperties(), mipLevels);
     auto view = createImageView(device, format, viewType, mipLevels, layers, image, aspectMask);
     this->image = std::move(image);
@@ -250,6 +155,31 @@ vk::Image::Image(const Device &device, uint32_t width, uint32_t height, uint32_t
     this->view = std::move(view);
 }
 
+vk::Image::~Image()
+{
+    retire();
+}
+
+auto vk::Image::operator=(Image &&other) -> Image&
+{
+    if (this != &other)
+    {
+        retire();
+        deletionQueue = other.deletionQueue;
+        memory = std::move(other.memory);
+        image = std::move(other.image);
+        view = std::move(other.view);
+        sampler = std::move(other.sampler);
+        layout = other.layout;
+        mipLevels = other.mipLevels;
+        layers = other.layers;
+        width = other.width;
+        height = other.height;
+        aspectMask = other.aspectMask;
+    }
+    return *this;
+}
+
 void vk::Image::uploadData(const Device &device, const ImageData &data)
 {
     uint32_t offset = 0;
@@ -274,46 +204,18 @@ void vk::Image::uploadData(const Device &device, const ImageData &data)
         }
     }
 
-    VkImageSubresourceRange subresourceRange{};
-	subresourceRange.aspectMask = aspectMask;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = mipLevels;
-	subresourceRange.layerCount = layers;
-
-    auto srcBuf = Buffer::createStaging(device, data.getSize(), data.getData());
-
-    auto cmdBuf = createCommandBuffer(device, device.getCommandPool());
-    beginCommandBuffer(cmdBuf, true);
-
-    setImageLayout(
-        cmdBuf,
-        image,
-        VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        subresourceRange,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
-
-    vkCmdCopyBufferToImage(
-        cmdBuf,
-        srcBuf,
-        image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        copyRegions.size(),
-        copyRegions.data());
-
-    auto imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    setImageLayout(
-        cmdBuf,
-        image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        imageLayout,
-        subresourceRange,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
-
-    vkEndCommandBuffer(cmdBuf);
+    device.getUploadQueue().uploadImage(image, aspectMask, getTexelSize(data.getFormat()), data.getData(), data.getSize(),
+        copyRegions, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+}
 
-    queueSubmit(device.getQueue(), 0, nullptr, 0, nullptr, 1, &cmdBuf);
-    KL_VK_CHECK_RESULT(vkQueueWaitIdle(device.getQueue()));
+void vk::Image::retire()
+{
+    if (!deletionQueue)
+        return;
+    // Views go before the image they view
+    deletionQueue->defer(std::move(view));
+    deletionQueue->defer(std::move(sampler));
+    deletionQueue->defer(std::move(image));
+    deletionQueue->defer(std::move(memory));
 }
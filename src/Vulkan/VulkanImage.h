@@ -6,6 +6,7 @@
 #pragma once
 
 #include "Vulkan.h"
+#include "VulkanMemoryAllocator.h"
 #include <glm/glm.hpp>
 
 class ImageData;
@@ -13,7 +14,10 @@ class ImageData;
 namespace vk
 {
     class Device;
+    class DeletionQueue;
 
+    // Like buffers, destroyed or replaced images go through the device's DeletionQueue along with their view and
+    // sampler
     class Image
     {
     public:
@@ -25,9 +29,10 @@ namespace vk
             VkImageCreateFlags createFlags, VkImageUsageFlags usageFlags, VkImageViewType viewType, VkImageAspectFlags aspectMask);
         Image(const Image &other) = delete;
         Image(Image &&other) = default;
+        ~Image();
 
         auto operator=(const Image &other) -> Image& = delete;
-        auto operator=(Image &&other) -> Image& = default;
+        auto operator=(Image &&other) -> Image&;
 
         auto getSize() const -> glm::vec2 { return {width, height}; }
         auto getLayout() const -> VkImageLayout { return layout; }
@@ -37,8 +42,9 @@ namespace vk
         void uploadData(const Device &device, const ImageData &data);
 
     private:
+        DeletionQueue *deletionQueue = nullptr;
+        Allocation memory;
         Resource<VkImage> image;
-        Resource<VkDeviceMemory> memory;
         Resource<VkImageView> view;
         Resource<VkSampler> sampler;
         VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -47,5 +53,7 @@ namespace vk
         uint32_t width = 0;
         uint32_t height = 0;
         VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+
+        void retire();
     };
 }
\ No newline at end of file
@@ -0,0 +1,279 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanMemoryAllocator.h"
+#include <algorithm>
+
+static const VkDeviceSize minNodeSize = 256;
+static const VkDeviceSize maxBlockSize = 64 * 1024 * 1024;
+
+static auto getLog2(VkDeviceSize value) -> uint32_t
+{
+    uint32_t result = 0;
+    while (value >>= 1)
+        result++;
+    return result;
+}
+
+static auto getBlockSize(VkDeviceSize heapSize) -> VkDeviceSize
+{
+    // Small heaps (e.g. the 256 MB device-local host-visible heap on some GPUs) shouldn't be taken up by a few blocks
+    auto size = maxBlockSize;
+    while (size > minNodeSize && size > heapSize / 8)
+        size >>= 1;
+    return size;
+}
+
+vk::Allocation::Allocation(Allocation &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+vk::Allocation::~Allocation()
+{
+    release();
+}
+
+auto vk::Allocation::operator=(Allocation &&other) noexcept -> Allocation&
+{
+    if (this != &other)
+    {
+        release();
+        allocator = other.allocator;
+        block = other.block;
+        memory = other.memory;
+        offset = other.offset;
+        size = other.size;
+        mappedData = other.mappedData;
+        other.allocator = nullptr;
+        other.memory = VK_NULL_HANDLE;
+    }
+    return *this;
+}
+
+void vk::Allocation::release()
+{
+    if (allocator && memory)
+        allocator->free(*this);
+    allocator = nullptr;
+    memory = VK_NULL_HANDLE;
+}
+
+vk::MemoryAllocator::MemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties &memProps):
+    device(device),
+    memProps(memProps)
+{
+    pools.resize(memProps.memoryTypeCount * 2);
+    for (uint32_t i = 0; i < pools.size(); i++)
+    {
+        const auto memoryType = i / 2;
+        auto &pool = pools[i];
+        pool.memoryType = memoryType;
+        pool.blockSize = getBlockSize(memProps.memoryHeaps[memProps.memoryTypes[memoryType].heapIndex].size);
+        pool.levelCount = getLog2(pool.blockSize / minNodeSize) + 1;
+    }
+}
+
+auto vk::MemoryAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties,
+    bool optimalTiling, bool dedicated) -> Allocation
+{
+    const auto memoryType = findMemoryType(memProps, requirements.memoryTypeBits, properties);
+    KL_PANIC_IF(memoryType < 0, "Failed to find memory type");
+
+    const auto hostVisible = (memProps.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+    auto &pool = pools[memoryType * 2 + (optimalTiling ? 1 : 0)];
+
+    Allocation result;
+    result.allocator = this;
+    result.size = requirements.size;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (dedicated || requirements.size > pool.blockSize / 2)
+    {
+        // Owned by the allocation itself and freed in free()
+        allocateMemory(memoryType, requirements.size, &result.memory);
+        if (hostVisible)
+            KL_VK_CHECK_RESULT(vkMapMemory(device, result.memory, 0, VK_WHOLE_SIZE, 0, &result.mappedData));
+
+        dedicatedAllocationCount++;
+        dedicatedBytes += requirements.size;
+        allocationCount++;
+
+        return result;
+    }
+
+    Block *block = nullptr;
+    for (auto &b: pool.blocks)
+    {
+        if (allocateFromBlock(pool, *b, requirements.size, requirements.alignment, result.offset))
+        {
+            block = b.get();
+            break;
+        }
+    }
+
+    if (!block)
+    {
+        auto newBlock = std::make_unique<Block>();
+        newBlock->memory = Resource<VkDeviceMemory>{device};
+        allocateMemory(memoryType, pool.blockSize, newBlock->memory.cleanRef());
+        newBlock->pool = static_cast<uint32_t>(&pool - pools.data());
+        newBlock->freeNodes.resize(pool.levelCount);
+        newBlock->freeNodes[0].insert(0);
+        if (hostVisible)
+            KL_VK_CHECK_RESULT(vkMapMemory(device, newBlock->memory, 0, VK_WHOLE_SIZE, 0, &newBlock->mappedData));
+
+        if (!allocateFromBlock(pool, *newBlock, requirements.size, requirements.alignment, result.offset))
+            KL_PANIC("Failed to allocate from a new memory block");
+
+        block = newBlock.get();
+        pool.blocks.push_back(std::move(newBlock));
+    }
+
+    result.block = block;
+    result.memory = block->memory;
+    if (block->mappedData)
+        result.mappedData = static_cast<uint8_t*>(block->mappedData) + result.offset;
+
+    allocationCount++;
+
+    return result;
+}
+
+auto vk::MemoryAllocator::getStats() const -> MemoryStats
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    MemoryStats stats;
+    stats.dedicatedAllocationCount = dedicatedAllocationCount;
+    stats.dedicatedBytes = dedicatedBytes;
+    stats.allocationCount = allocationCount;
+
+    for (const auto &pool: pools)
+    {
+        for (const auto &block: pool.blocks)
+        {
+            stats.blockCount++;
+            stats.blockBytes += pool.blockSize;
+            stats.requestedBytes += block->requestedBytes;
+            stats.usedBytes += block->usedBytes;
+
+            for (uint32_t level = 0; level < pool.levelCount; level++)
+            {
+                if (!block->freeNodes[level].empty())
+                {
+                    stats.largestFreeRange = (std::max)(stats.largestFreeRange, pool.blockSize >> level);
+                    break;
+                }
+            }
+        }
+    }
+
+    return stats;
+}
+
+void vk::MemoryAllocator::allocateMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory *memory) const
+{
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    KL_VK_CHECK_RESULT(vkAllocateMemory(device, &allocInfo, nullptr, memory));
+}
+
+auto vk::MemoryAllocator::allocateFromBlock(Pool &pool, Block &block, VkDeviceSize size, VkDeviceSize alignment,
+    VkDeviceSize &offset) -> bool
+{
+    // Smallest node that fits both the size and the alignment
+    auto nodeSize = (std::max)(minNodeSize, alignment);
+    while (nodeSize < size)
+        nodeSize <<= 1;
+    if (nodeSize > pool.blockSize)
+        return false;
+
+    const auto targetLevel = getLog2(pool.blockSize / nodeSize);
+
+    // Find the smallest free node that can hold it
+    auto level = static_cast<int32_t>(targetLevel);
+    while (level >= 0 && block.freeNodes[level].empty())
+        level--;
+    if (level < 0)
+        return false;
+
+    offset = *block.freeNodes[level].begin();
+    block.freeNodes[level].erase(block.freeNodes[level].begin());
+
+    // Split it down to the target size, keeping the left halves
+    while (static_cast<uint32_t>(level) < targetLevel)
+    {
+        level++;
+        block.freeNodes[level].insert(offset + (pool.blockSize >> level));
+    }
+
+    block.usedNodes[offset] = targetLevel;
+    block.requestedBytes += size;
+    block.usedBytes += nodeSize;
+
+    return true;
+}
+
+void vk::MemoryAllocator::free(const Allocation &allocation)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    allocationCount--;
+
+    if (!allocation.block)
+    {
+        vkFreeMemory(device, allocation.memory, nullptr);
+        dedicatedAllocationCount--;
+        dedicatedBytes -= allocation.size;
+        return;
+    }
+
+    auto &block = *static_cast<Block*>(allocation.block);
+    auto &pool = pools[block.pool];
+    freeNode(pool, block, allocation.offset, allocation.size);
+
+    // Keep one empty block per pool around so that alternating allocation/free don't hit the driver each time
+    if (!block.usedBytes)
+    {
+        const auto emptyBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(),
+            [](const uptr<Block> &b) { return !b->usedBytes; });
+        if (emptyBlocks > 1)
+        {
+            pool.blocks.erase(std::remove_if(pool.blocks.begin(), pool.blocks.end(),
+                [&](const uptr<Block> &b) { return b.get() == &block; }), pool.blocks.end());
+        }
+    }
+}
+
+void vk::MemoryAllocator::freeNode(Pool &pool, Block &block, VkDeviceSize offset, VkDeviceSize size)
+{
+    const auto it = block.usedNodes.find(offset);
+    KL_PANIC_IF(it == block.usedNodes.end(), "Freeing unknown allocation");
+
+    auto level = it->second;
+    block.usedNodes.erase(it);
+    block.requestedBytes -= size;
+    block.usedBytes -= pool.blockSize >> level;
+
+    // Merge with free buddies as far up as possible
+    while (level > 0)
+    {
+        const auto buddy = offset ^ (pool.blockSize >> level);
+        auto &freeNodes = block.freeNodes[level];
+        const auto buddyIt = freeNodes.find(buddy);
+        if (buddyIt == freeNodes.end())
+            break;
+        freeNodes.erase(buddyIt);
+        offset = (std::min)(offset, buddy);
+        level--;
+    }
+
+    block.freeNodes[level].insert(offset);
+}
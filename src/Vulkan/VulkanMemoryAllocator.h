@@ -0,0 +1,130 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+
+namespace vk
+{
+    class MemoryAllocator;
+
+    struct MemoryStats
+    {
+        uint32_t blockCount = 0;
+        uint32_t dedicatedAllocationCount = 0;
+        uint32_t allocationCount = 0; // live allocations, including dedicated ones
+        VkDeviceSize blockBytes = 0; // reserved in blocks
+        VkDeviceSize dedicatedBytes = 0;
+        VkDeviceSize requestedBytes = 0; // as requested by resources, in blocks
+        VkDeviceSize usedBytes = 0; // occupied in blocks, including the rounding up to buddy node size
+        VkDeviceSize largestFreeRange = 0;
+
+        // Share of used block memory lost to rounding up
+        auto getInternalFragmentation() const -> double
+        {
+            return usedBytes ? 1.0 - static_cast<double>(requestedBytes) / usedBytes : 0;
+        }
+
+        // Share of free block memory that can't be handed out as one allocation
+        auto getExternalFragmentation() const -> double
+        {
+            const auto freeBytes = blockBytes - usedBytes;
+            return freeBytes ? 1.0 - static_cast<double>(largestFreeRange) / freeBytes : 0;
+        }
+    };
+
+    // Piece of device memory obtained from MemoryAllocator, returned to it on destruction
+    class Allocation
+    {
+    public:
+        Allocation() {}
+        Allocation(const Allocation &other) = delete;
+        Allocation(Allocation &&other) noexcept;
+        ~Allocation();
+
+        auto operator=(const Allocation &other) -> Allocation& = delete;
+        auto operator=(Allocation &&other) noexcept -> Allocation&;
+
+        auto getMemory() const -> VkDeviceMemory { return memory; }
+        auto getOffset() const -> VkDeviceSize { return offset; }
+        auto getSize() const -> VkDeviceSize { return size; }
+
+        // Host-visible memory stays mapped for its whole lifetime, null for other memory
+        auto getMappedData() const -> void* { return mappedData; }
+
+    private:
+        friend class MemoryAllocator;
+
+        MemoryAllocator *allocator = nullptr;
+        void *block = nullptr; // null for dedicated allocations
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void *mappedData = nullptr;
+
+        void release();
+    };
+
+    // Sub-allocates resources from large per-memory-type blocks using a buddy allocator. Node offsets are multiples
+    // of node sizes, so any power-of-two alignment is met by picking a large enough node. Linear resources (buffers)
+    // and optimal-tiling images never share a block, so bufferImageGranularity never has to be padded for.
+    // Allocations too large for a block get their own VkDeviceMemory. Thread-safe.
+    class MemoryAllocator
+    {
+    public:
+        MemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties &memProps);
+        MemoryAllocator(const MemoryAllocator &other) = delete;
+        MemoryAllocator(MemoryAllocator &&other) = delete;
+        ~MemoryAllocator() {}
+
+        auto operator=(const MemoryAllocator &other) -> MemoryAllocator& = delete;
+        auto operator=(MemoryAllocator &&other) -> MemoryAllocator& = delete;
+
+        auto allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, bool optimalTiling,
+            bool dedicated = false) -> Allocation;
+
+        auto getStats() const -> MemoryStats;
+
+    private:
+        friend class Allocation;
+
+        struct Block
+        {
+            Resource<VkDeviceMemory> memory;
+            void *mappedData = nullptr;
+            uint32_t pool = 0;
+            std::vector<std::set<VkDeviceSize>> freeNodes; // per level, level 0 being the whole block
+            std::unordered_map<VkDeviceSize, uint32_t> usedNodes; // offset -> level
+            VkDeviceSize requestedBytes = 0;
+            VkDeviceSize usedBytes = 0;
+        };
+
+        struct Pool
+        {
+            uint32_t memoryType = 0;
+            VkDeviceSize blockSize = 0;
+            uint32_t levelCount = 0;
+            std::vector<uptr<Block>> blocks;
+        };
+
+        VkDevice device = nullptr;
+        VkPhysicalDeviceMemoryProperties memProps{};
+        std::vector<Pool> pools; // two per memory type: linear and optimal
+        mutable std::mutex mutex;
+        uint32_t dedicatedAllocationCount = 0;
+        uint32_t allocationCount = 0;
+        VkDeviceSize dedicatedBytes = 0;
+
+        void allocateMemory(uint32_t memoryType, VkDeviceSize size, VkDeviceMemory *memory) const;
+        auto allocateFromBlock(Pool &pool, Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset) -> bool;
+        void free(const Allocation &allocation);
+        void freeNode(Pool &pool, Block &block, VkDeviceSize offset, VkDeviceSize size);
+    };
+}
@@ -0,0 +1,91 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanParallelRecorder.h"
+#include "VulkanDevice.h"
+#include "../ThreadPool.h"
+#include <algorithm>
+
+vk::ParallelRecorder::ParallelRecorder(const Device &device, ThreadPool &threadPool, uint32_t frameCount,
+    uint32_t minDrawsPerRange):
+    device(device),
+    threadPool(&threadPool),
+    minDrawsPerRange((std::max)(minDrawsPerRange, 1u))
+{
+    const auto rangeCount = threadPool.getThreadCount() + 1;
+
+    frames.resize(frameCount);
+    for (auto &ranges: frames)
+    {
+        ranges.resize(rangeCount);
+        for (auto &range: ranges)
+        {
+            range.pool = createCommandPool(device, device.getQueueIndex(), VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+            range.buffer = createCommandBuffer(device, range.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        }
+    }
+
+    recorded.reserve(rangeCount);
+}
+
+void vk::ParallelRecorder::record(VkCommandBuffer primary, uint32_t frameIndex, VkRenderPass renderPass, uint32_t subpass,
+    VkFramebuffer framebuffer, uint32_t drawCount, const RecordDraws &recordDraws)
+{
+    const auto rangeCount = getRangeCount(drawCount);
+    if (!rangeCount)
+        return;
+
+    auto &ranges = frames[frameIndex];
+    const auto drawsPerRange = drawCount / rangeCount;
+    const auto remainder = drawCount % rangeCount;
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = subpass;
+    inheritanceInfo.framebuffer = framebuffer;
+
+    auto recordRange = [&](uint32_t index)
+    {
+        auto &range = ranges[index];
+        const auto first = index * drawsPerRange + (std::min)(index, remainder);
+        const auto count = drawsPerRange + (index < remainder ? 1 : 0);
+
+        KL_VK_CHECK_RESULT(vkResetCommandPool(device, range.pool, 0));
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+        KL_VK_CHECK_RESULT(vkBeginCommandBuffer(range.buffer, &beginInfo));
+
+        recordDraws(range.buffer, first, count);
+
+        KL_VK_CHECK_RESULT(vkEndCommandBuffer(range.buffer));
+    };
+
+    // The calling thread takes the first range instead of idling until the workers are done
+    std::vector<std::future<void>> futures;
+    futures.reserve(rangeCount - 1);
+    for (uint32_t i = 1; i < rangeCount; i++)
+        futures.push_back(threadPool->enqueue([&recordRange, i] { recordRange(i); }));
+    recordRange(0);
+    // Tasks refer to this frame's locals, so all must finish before any error is rethrown
+    for (auto &future: futures)
+        future.wait();
+    for (auto &future: futures)
+        future.get();
+
+    recorded.clear();
+    for (uint32_t i = 0; i < rangeCount; i++)
+        recorded.push_back(ranges[i].buffer);
+    vkCmdExecuteCommands(primary, rangeCount, recorded.data());
+}
+
+auto vk::ParallelRecorder::getRangeCount(uint32_t drawCount) const -> uint32_t
+{
+    const auto maxRangeCount = frames.empty() ? 0 : static_cast<uint32_t>(frames[0].size());
+    return (std::min)((drawCount + minDrawsPerRange - 1) / minDrawsPerRange, maxRangeCount);
+}
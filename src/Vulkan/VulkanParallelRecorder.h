@@ -0,0 +1,59 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include <vector>
+#include <functional>
+
+class ThreadPool;
+
+namespace vk
+{
+    class Device;
+
+    // Records the draws of a subpass into secondary command buffers on the thread pool and executes them from
+    // the primary one. Draws are split into contiguous ranges, one per worker thread plus one recorded by the calling
+    // thread, so their order is kept. Every range has a command pool of its own per frame in flight, which is reset
+    // as a whole when the frame comes around again, so no pool is ever used by two threads at once.
+    class ParallelRecorder
+    {
+    public:
+        // Records draws [first, first + count). Viewport and scissor aren't inherited by secondary buffers, so
+        // it must set them.
+        using RecordDraws = std::function<void(VkCommandBuffer buf, uint32_t first, uint32_t count)>;
+
+        ParallelRecorder() {}
+        // Lists shorter than minDrawsPerRange per worker use fewer ranges, down to recording on the calling thread alone
+        ParallelRecorder(const Device &device, ThreadPool &threadPool, uint32_t frameCount, uint32_t minDrawsPerRange);
+        ParallelRecorder(const ParallelRecorder &other) = delete;
+        ParallelRecorder(ParallelRecorder &&other) = default;
+        ~ParallelRecorder() {}
+
+        auto operator=(const ParallelRecorder &other) -> ParallelRecorder& = delete;
+        auto operator=(ParallelRecorder &&other) -> ParallelRecorder& = default;
+
+        // The primary buffer must be inside the render pass, begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+        // Command buffers of the frame must no longer be in use. Returns when all ranges have been recorded.
+        void record(VkCommandBuffer primary, uint32_t frameIndex, VkRenderPass renderPass, uint32_t subpass,
+            VkFramebuffer framebuffer, uint32_t drawCount, const RecordDraws &recordDraws);
+
+        auto getRangeCount(uint32_t drawCount) const -> uint32_t;
+
+    private:
+        struct Range
+        {
+            Resource<VkCommandPool> pool;
+            Resource<VkCommandBuffer> buffer;
+        };
+
+        VkDevice device = nullptr;
+        ThreadPool *threadPool = nullptr;
+        uint32_t minDrawsPerRange = 1;
+        std::vector<std::vector<Range>> frames; // ranges of each frame in flight
+        std::vector<VkCommandBuffer> recorded;
+    };
+}
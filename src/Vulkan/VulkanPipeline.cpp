@@ -4,9 +4,90 @@
 */
 
 #include "VulkanPipeline.h"
+#include "VulkanDevice.h"
+#include "VulkanShaderReflection.h"
 #include "../MeshData.h"
+#include "../HashUtils.h"
+#include <chrono>
+#include <algorithm>
 
-vk::Pipeline::Pipeline(VkDevice device, VkRenderPass renderPass, const PipelineConfig &config)
+static bool equal(const VkStencilOpState &a, const VkStencilOpState &b)
+{
+    return a.failOp == b.failOp &&
+        a.passOp == b.passOp &&
+        a.depthFailOp == b.depthFailOp &&
+        a.compareOp == b.compareOp &&
+        a.compareMask == b.compareMask &&
+        a.writeMask == b.writeMask &&
+        a.reference == b.reference;
+}
+
+static bool equal(const VkPipelineRasterizationStateCreateInfo &a, const VkPipelineRasterizationStateCreateInfo &b)
+{
+    return a.depthClampEnable == b.depthClampEnable &&
+        a.rasterizerDiscardEnable == b.rasterizerDiscardEnable &&
+        a.polygonMode == b.polygonMode &&
+        a.cullMode == b.cullMode &&
+        a.frontFace == b.frontFace &&
+        a.depthBiasEnable == b.depthBiasEnable &&
+        a.depthBiasConstantFactor == b.depthBiasConstantFactor &&
+        a.depthBiasClamp == b.depthBiasClamp &&
+        a.depthBiasSlopeFactor == b.depthBiasSlopeFactor &&
+        a.lineWidth == b.lineWidth;
+}
+
+static bool equal(const VkPipelineDepthStencilStateCreateInfo &a, const VkPipelineDepthStencilStateCreateInfo &b)
+{
+    return a.depthTestEnable == b.depthTestEnable &&
+        a.depthWriteEnable == b.depthWriteEnable &&
+        a.depthCompareOp == b.depthCompareOp &&
+        a.depthBoundsTestEnable == b.depthBoundsTestEnable &&
+        a.stencilTestEnable == b.stencilTestEnable &&
+        equal(a.front, b.front) &&
+        equal(a.back, b.back) &&
+        a.minDepthBounds == b.minDepthBounds &&
+        a.maxDepthBounds == b.maxDepthBounds;
+}
+
+static bool equal(const VkPipelineColorBlendAttachmentState &a, const VkPipelineColorBlendAttachmentState &b)
+{
+    return a.blendEnable == b.blendEnable &&
+        a.srcColorBlendFactor == b.srcColorBlendFactor &&
+        a.dstColorBlendFactor == b.dstColorBlendFactor &&
+        a.colorBlendOp == b.colorBlendOp &&
+        a.srcAlphaBlendFactor == b.srcAlphaBlendFactor &&
+        a.dstAlphaBlendFactor == b.dstAlphaBlendFactor &&
+        a.alphaBlendOp == b.alphaBlendOp &&
+        a.colorWriteMask == b.colorWriteMask;
+}
+
+static bool equal(const VkVertexInputAttributeDescription &a, const VkVertexInputAttributeDescription &b)
+{
+    return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+}
+
+static bool equal(const VkVertexInputBindingDescription &a, const VkVertexInputBindingDescription &b)
+{
+    return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+}
+
+static bool equal(const VkPushConstantRange &a, const VkPushConstantRange &b)
+{
+    return a.stageFlags == b.stageFlags && a.offset == b.offset && a.size == b.size;
+}
+
+static bool equal(const VkSpecializationMapEntry &a, const VkSpecializationMapEntry &b)
+{
+    return a.constantID == b.constantID && a.offset == b.offset && a.size == b.size;
+}
+
+template <class T>
+static bool equal(const std::vector<T> &a, const std::vector<T> &b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const T &x, const T &y) { return equal(x, y); });
+}
+
+vk::Pipeline::Pipeline(const Device &device, VkRenderPass renderPass, const PipelineConfig &config)
 {
     VkPipelineLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -14,10 +95,10 @@ vk::Pipeline::Pipeline(VkDevice device, VkRenderPass renderPass, const PipelineC
     layoutInfo.flags = 0;
     layoutInfo.setLayoutCount = config.descSetLayouts.size();
     layoutInfo.pSetLayouts = config.descSetLayouts.data();
-    layoutInfo.pushConstantRangeCount = 0;
-    layoutInfo.pPushConstantRanges = nullptr;
+    layoutInfo.pushConstantRangeCount = config.pushConstantRanges.size();
+    layoutInfo.pPushConstantRanges = config.pushConstantRanges.data();
 
-    Resource<VkPipelineLayout> layout{device, vkDestroyPipelineLayout};
+    Resource<VkPipelineLayout> layout{device};
     KL_VK_CHECK_RESULT(vkCreatePipelineLayout(device, &layoutInfo, nullptr, layout.cleanRef()));
 
     VkPipelineMultisampleStateCreateInfo multisampleState{};
@@ -44,8 +125,10 @@ vk::Pipeline::Pipeline(VkDevice device, VkRenderPass renderPass, const PipelineC
     colorBlendState.blendConstants[2] = 0;
     colorBlendState.blendConstants[3] = 0;
 
-    auto vertexShaderStageInfo = createShaderStageInfo(true, config.vertexShader, "main");
-    auto fragmentShaderStageInfo = createShaderStageInfo(false, config.fragmentShader, "main");
+    const auto vertexConstants = config.vertexConstants.getInfo();
+    const auto fragmentConstants = config.fragmentConstants.getInfo();
+    auto vertexShaderStageInfo = createShaderStageInfo(VK_SHADER_STAGE_VERTEX_BIT, config.vertexShader, "main", &vertexConstants);
+    auto fragmentShaderStageInfo = createShaderStageInfo(VK_SHADER_STAGE_FRAGMENT_BIT, config.fragmentShader, "main", &fragmentConstants);
 
     std::vector<VkPipelineShaderStageCreateInfo> shaderStageStates{vertexShaderStageInfo, fragmentShaderStageInfo};
 
@@ -103,8 +186,13 @@ vk::Pipeline::Pipeline(VkDevice device, VkRenderPass renderPass, const PipelineC
     pipelineInfo.basePipelineHandle = nullptr;
     pipelineInfo.basePipelineIndex = -1;
 
-    Resource<VkPipeline> pipeline{device, vkDestroyPipeline};
-    KL_VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipeline.cleanRef()));
+    const auto startTime = std::chrono::high_resolution_clock::now();
+
+    Resource<VkPipeline> pipeline{device};
+    KL_VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, device.getPipelineCache(), 1, &pipelineInfo, nullptr, pipeline.cleanRef()));
+
+    const std::chrono::duration<double, std::milli> creationTime = std::chrono::high_resolution_clock::now() - startTime;
+    device.notifyPipelineCreated(creationTime.count());
 
     this->pipeline = std::move(pipeline);
     this->layout = std::move(layout);
@@ -148,6 +236,94 @@ vk::PipelineConfig::PipelineConfig(VkShaderModule vertexShader, VkShaderModule f
     blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 }
 
+bool vk::PipelineConfig::operator==(const PipelineConfig &other) const
+{
+    return vertexShader == other.vertexShader &&
+        fragmentShader == other.fragmentShader &&
+        topology == other.topology &&
+        descSetLayouts == other.descSetLayouts &&
+        equal(rasterStateInfo, other.rasterStateInfo) &&
+        equal(depthStencilStateInfo, other.depthStencilStateInfo) &&
+        equal(blendAttachmentState, other.blendAttachmentState) &&
+        equal(vertexAttrs, other.vertexAttrs) &&
+        equal(vertexBindings, other.vertexBindings) &&
+        equal(pushConstantRanges, other.pushConstantRanges) &&
+        vertexConstants == other.vertexConstants &&
+        fragmentConstants == other.fragmentConstants;
+}
+
+auto vk::PipelineConfig::hash() const -> size_t
+{
+    // Covers only the state that usually differs between pipelines, the rest is resolved by operator==
+    size_t result = 0;
+    hashutils::combine(result, vertexShader);
+    hashutils::combine(result, fragmentShader);
+    hashutils::combine(result, static_cast<uint32_t>(topology));
+    for (const auto layout: descSetLayouts)
+        hashutils::combine(result, layout);
+    for (const auto &range: pushConstantRanges)
+        hashutils::combine(result, range.stageFlags ^ (range.size << 8));
+    for (const auto &attr: vertexAttrs)
+        hashutils::combine(result, static_cast<uint32_t>(attr.format) ^ (attr.offset << 16));
+    for (const auto &binding: vertexBindings)
+        hashutils::combine(result, binding.stride);
+    hashutils::combine(result, rasterStateInfo.cullMode);
+    hashutils::combine(result, static_cast<uint32_t>(rasterStateInfo.frontFace));
+    hashutils::combine(result, depthStencilStateInfo.depthTestEnable | (depthStencilStateInfo.depthWriteEnable << 1));
+    hashutils::combine(result, blendAttachmentState.blendEnable);
+    hashutils::combine(result, vertexConstants.hash());
+    hashutils::combine(result, fragmentConstants.hash());
+    return result;
+}
+
+auto vk::PipelineConfig::getConstants(VkShaderStageFlagBits stage) -> SpecializationConstants&
+{
+    KL_PANIC_IF(stage != VK_SHADER_STAGE_VERTEX_BIT && stage != VK_SHADER_STAGE_FRAGMENT_BIT, "Unsupported shader stage");
+    return stage == VK_SHADER_STAGE_VERTEX_BIT ? vertexConstants : fragmentConstants;
+}
+
+void vk::SpecializationConstants::set(uint32_t constantId, const void *data, size_t size)
+{
+    const auto bytes = reinterpret_cast<const uint8_t*>(data);
+
+    for (const auto &entry: entries)
+    {
+        if (entry.constantID == constantId)
+        {
+            KL_PANIC_IF(entry.size != size, "Specialization constant size mismatch");
+            std::copy(bytes, bytes + size, this->data.begin() + entry.offset);
+            return;
+        }
+    }
+
+    VkSpecializationMapEntry entry{};
+    entry.constantID = constantId;
+    entry.offset = this->data.size();
+    entry.size = size;
+    entries.push_back(entry);
+    this->data.insert(this->data.end(), bytes, bytes + size);
+}
+
+auto vk::SpecializationConstants::getInfo() const -> VkSpecializationInfo
+{
+    VkSpecializationInfo info{};
+    info.mapEntryCount = entries.size();
+    info.pMapEntries = entries.data();
+    info.dataSize = data.size();
+    info.pData = data.data();
+    return info;
+}
+
+auto vk::SpecializationConstants::hash() const -> size_t
+{
+    return hashutils::fnv1a(data.data(), data.size());
+}
+
+bool vk::SpecializationConstants::operator==(const SpecializationConstants &other) const
+{
+    return equal(entries, other.entries) && data == other.data;
+}
+
 auto vk::PipelineConfig::withVertexAttribute(uint32_t location, uint32_t binding, VkFormat format, uint32_t offset) -> PipelineConfig&
 {
     if (location >= vertexAttrs.size())
@@ -197,12 +373,52 @@ auto vk::PipelineConfig::withVertexFormat(const VertexFormat &format) -> Pipelin
     return *this;
 }
 
+auto vk::PipelineConfig::withVertexInput(const ShaderReflection &reflection, uint32_t stride) -> PipelineConfig&
+{
+    uint32_t offset = 0;
+    for (const auto &input: reflection.getVertexInputs())
+    {
+        withVertexAttribute(input.location, 0, input.format, offset);
+        offset += input.size;
+    }
+
+    return withVertexBinding(0, stride ? stride : offset, VK_VERTEX_INPUT_RATE_VERTEX);
+}
+
 auto vk::PipelineConfig::withDescriptorSetLayout(VkDescriptorSetLayout layout) -> PipelineConfig&
 {
     descSetLayouts.push_back(layout);
     return *this;
 }
 
+auto vk::PipelineConfig::withDescriptorSetLayouts(const std::vector<VkDescriptorSetLayout> &layouts) -> PipelineConfig&
+{
+    descSetLayouts.insert(descSetLayouts.end(), layouts.begin(), layouts.end());
+    return *this;
+}
+
+auto vk::PipelineConfig::withPushConstants(VkShaderStageFlags stages, uint32_t offset, uint32_t size) -> PipelineConfig&
+{
+    // Spec requires both to be multiples of 4
+    KL_PANIC_IF(offset % 4 || size % 4, "Push constant offset and size must be multiples of 4");
+
+    VkPushConstantRange range{};
+    range.stageFlags = stages;
+    range.offset = offset;
+    range.size = size;
+    pushConstantRanges.push_back(range);
+
+    return *this;
+}
+
+auto vk::PipelineConfig::withPushConstants(const ShaderReflection &reflection) -> PipelineConfig&
+{
+    const auto &pushConstants = reflection.getPushConstants();
+    if (pushConstants.size)
+        withPushConstants(pushConstants.stages, pushConstants.offset, pushConstants.size);
+    return *this;
+}
+
 auto vk::PipelineConfig::withFrontFace(VkFrontFace frontFace) -> PipelineConfig&
 {
     rasterStateInfo.frontFace = frontFace;
@@ -7,11 +7,46 @@
 
 #include "Vulkan.h"
 #include <vector>
+#include <type_traits>
 
 class VertexFormat;
 
 namespace vk
 {
+    class Device;
+    class ShaderReflection;
+
+    // Specialization constants of one shader stage. Values are copied in, so the storage can outlive the caller's variables.
+    class SpecializationConstants
+    {
+    public:
+        // Booleans are converted to VkBool32 as required by SPIR-V
+        template <class T>
+        void set(uint32_t constantId, const T &value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Specialization constant must be trivially copyable");
+            set(constantId, &value, sizeof(T));
+        }
+
+        void set(uint32_t constantId, bool value)
+        {
+            const VkBool32 vkValue = value ? VK_TRUE : VK_FALSE;
+            set(constantId, &vkValue, sizeof(vkValue));
+        }
+
+        void set(uint32_t constantId, const void *data, size_t size);
+
+        auto getInfo() const -> VkSpecializationInfo;
+        auto hash() const -> size_t;
+
+        bool operator==(const SpecializationConstants &other) const;
+        bool operator!=(const SpecializationConstants &other) const { return !(*this == other); }
+
+    private:
+        std::vector<VkSpecializationMapEntry> entries;
+        std::vector<uint8_t> data;
+    };
+
     class PipelineConfig
     {
     public:
@@ -21,8 +56,13 @@ namespace vk
         auto withVertexAttribute(uint32_t location, uint32_t binding, VkFormat format, uint32_t offset) -> PipelineConfig&;
         auto withVertexBinding(uint32_t binding, uint32_t stride, VkVertexInputRate inputRate) -> PipelineConfig&;
         auto withVertexFormat(const VertexFormat &format) -> PipelineConfig&;
+        // Single interleaved binding with the inputs declared by the vertex shader. Stride defaults to their packed size
+        auto withVertexInput(const ShaderReflection &reflection, uint32_t stride = 0) -> PipelineConfig&;
 
         auto withDescriptorSetLayout(VkDescriptorSetLayout layout) -> PipelineConfig&;
+        auto withDescriptorSetLayouts(const std::vector<VkDescriptorSetLayout> &layouts) -> PipelineConfig&;
+        auto withPushConstants(VkShaderStageFlags stages, uint32_t offset, uint32_t size) -> PipelineConfig&;
+        auto withPushConstants(const ShaderReflection &reflection) -> PipelineConfig&;
 
         auto withFrontFace(VkFrontFace frontFace) -> PipelineConfig&;
         auto withCullMode(VkCullModeFlags cullFlags) -> PipelineConfig&;
@@ -38,6 +78,19 @@ namespace vk
             return *this;
         }
 
+        template <class T>
+        auto withSpecializationConstant(VkShaderStageFlagBits stage, uint32_t constantId, const T &value) -> PipelineConfig&
+        {
+            getConstants(stage).set(constantId, value);
+            return *this;
+        }
+
+        // Two configs are equal if they would produce identical pipelines (for the same render pass)
+        bool operator==(const PipelineConfig &other) const;
+        bool operator!=(const PipelineConfig &other) const { return !(*this == other); }
+
+        auto hash() const -> size_t;
+
     private:
         friend class Pipeline;
 
@@ -50,15 +103,20 @@ namespace vk
         std::vector<VkVertexInputAttributeDescription> vertexAttrs;
         std::vector<VkVertexInputBindingDescription> vertexBindings;
         std::vector<VkDescriptorSetLayout> descSetLayouts;
+        std::vector<VkPushConstantRange> pushConstantRanges;
+        SpecializationConstants vertexConstants;
+        SpecializationConstants fragmentConstants;
 
         VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        auto getConstants(VkShaderStageFlagBits stage) -> SpecializationConstants&;
     };
 
     class Pipeline
     {
     public:
         Pipeline() {}
-        Pipeline(VkDevice device, VkRenderPass renderPass, const PipelineConfig &config);
+        Pipeline(const Device &device, VkRenderPass renderPass, const PipelineConfig &config);
         Pipeline(const Pipeline &other) = delete;
         Pipeline(Pipeline &&other) = default;
         ~Pipeline() {}
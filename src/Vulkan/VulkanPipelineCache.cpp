@@ -0,0 +1,184 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanPipelineCache.h"
+#include "VulkanDevice.h"
+#include "VulkanDescriptorSetLayoutBuilder.h"
+#include "VulkanShaderReflection.h"
+#include "../HashUtils.h"
+#include "../ThreadPool.h"
+#include <tuple>
+
+vk::PipelineCache::PipelineCache(const Device &device, ThreadPool &threadPool):
+    device(device),
+    threadPool(threadPool)
+{
+}
+
+vk::PipelineCache::~PipelineCache()
+{
+    // Worker threads may still reference the shaders and layouts owned by the cache
+    wait();
+}
+
+auto vk::PipelineCache::getShader(const std::vector<uint32_t> &spirv) -> VkShaderModule
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = shaders.find(spirv);
+    if (it == shaders.end())
+        it = shaders.emplace(spirv, createShader(device, spirv)).first;
+    return it->second;
+}
+
+auto vk::PipelineCache::getDescriptorSetLayout(const DescriptorSetLayoutBuilder &builder) -> VkDescriptorSetLayout
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = setLayouts.find(builder.getBindings());
+    if (it == setLayouts.end())
+        it = setLayouts.emplace(builder.getBindings(), builder.build()).first;
+    return it->second;
+}
+
+auto vk::PipelineCache::getDescriptorSetLayouts(const ShaderReflection &reflection) -> std::vector<VkDescriptorSetLayout>
+{
+    std::vector<VkDescriptorSetLayout> result;
+    for (uint32_t set = 0; set < reflection.getSetCount(); set++)
+        result.push_back(getDescriptorSetLayout(reflection.getSetLayoutBuilder(device, set)));
+    return result;
+}
+
+auto vk::PipelineCache::getPipeline(VkRenderPass renderPass, const PipelineConfig &config) -> sptr<Pipeline>
+{
+    std::promise<sptr<Pipeline>> promise;
+    std::shared_future<sptr<Pipeline>> existing;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pipelineRequests++;
+
+        PipelineKey key{renderPass, config};
+        auto it = pipelines.find(key);
+        if (it != pipelines.end())
+            existing = it->second;
+        else
+            pipelines.emplace(std::move(key), promise.get_future().share());
+    }
+
+    if (existing.valid())
+        return existing.get();
+
+    // Compiling outside of the lock so that other threads can keep using the cache meanwhile
+    auto pipeline = std::make_shared<Pipeline>(device, renderPass, config);
+    promise.set_value(pipeline);
+
+    return pipeline;
+}
+
+auto vk::PipelineCache::getPipelineAsync(VkRenderPass renderPass, const PipelineConfig &config) -> std::shared_future<sptr<Pipeline>>
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pipelineRequests++;
+
+    PipelineKey key{renderPass, config};
+    auto it = pipelines.find(key);
+    if (it != pipelines.end())
+        return it->second;
+
+    const auto &device = this->device;
+    auto future = threadPool.enqueue([&device, renderPass, config]
+    {
+        return std::make_shared<Pipeline>(device, renderPass, config);
+    }).share();
+
+    pipelines.emplace(std::move(key), future);
+
+    return future;
+}
+
+void vk::PipelineCache::wait()
+{
+    std::vector<std::shared_future<sptr<Pipeline>>> pending;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &pipeline: pipelines)
+            pending.push_back(pipeline.second);
+    }
+
+    for (const auto &future: pending)
+        future.wait();
+}
+
+auto vk::PipelineCache::getPipelineCount() const -> uint32_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipelines.size();
+}
+
+auto vk::PipelineCache::getPipelineRequestCount() const -> uint32_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipelineRequests;
+}
+
+auto vk::PipelineCache::PipelineKeyHash::operator()(const PipelineKey &key) const -> size_t
+{
+    auto result = key.config.hash();
+    hashutils::combine(result, key.renderPass);
+    return result;
+}
+
+bool vk::PipelineCache::LayoutBindingLess::operator()(const std::vector<VkDescriptorSetLayoutBinding> &a,
+    const std::vector<VkDescriptorSetLayoutBinding> &b) const
+{
+    // Immutable samplers are not used, so they are not part of the key
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+        [](const VkDescriptorSetLayoutBinding &x, const VkDescriptorSetLayoutBinding &y)
+        {
+            return std::tie(x.binding, x.descriptorType, x.descriptorCount, x.stageFlags) <
+                std::tie(y.binding, y.descriptorType, y.descriptorCount, y.stageFlags);
+        });
+}
+
+vk::PipelinePermutations::PipelinePermutations(PipelineCache &cache, VkRenderPass renderPass, const PipelineConfig &baseConfig,
+    VkShaderStageFlags stages, uint32_t featureCount, uint32_t firstConstantId):
+    cache(&cache),
+    renderPass(renderPass),
+    baseConfig(baseConfig),
+    stages(stages),
+    featureCount(featureCount),
+    firstConstantId(firstConstantId)
+{
+    KL_PANIC_IF(featureCount > 32, "Too many permutation features");
+}
+
+auto vk::PipelinePermutations::get(uint32_t featureMask) -> std::shared_future<sptr<Pipeline>>
+{
+    const auto existing = variants.find(featureMask);
+    if (existing != variants.end())
+        return existing->second;
+
+    KL_PANIC_IF(featureCount < 32 && (featureMask >> featureCount), "Unknown permutation feature");
+
+    auto config = baseConfig;
+    for (uint32_t i = 0; i < featureCount; i++)
+    {
+        const bool enabled = (featureMask & (1u << i)) != 0;
+        if (stages & VK_SHADER_STAGE_VERTEX_BIT)
+            config.withSpecializationConstant(VK_SHADER_STAGE_VERTEX_BIT, firstConstantId + i, enabled);
+        if (stages & VK_SHADER_STAGE_FRAGMENT_BIT)
+            config.withSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, firstConstantId + i, enabled);
+    }
+
+    auto pipeline = cache->getPipelineAsync(renderPass, config);
+    variants[featureMask] = pipeline;
+    return pipeline;
+}
+
+void vk::PipelinePermutations::prewarm(const std::vector<uint32_t> &featureMasks)
+{
+    for (const auto mask: featureMasks)
+        get(mask);
+}
@@ -0,0 +1,115 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanPipeline.h"
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <future>
+#include <mutex>
+
+class ThreadPool;
+
+namespace vk
+{
+    class Device;
+    class DescriptorSetLayoutBuilder;
+    class ShaderReflection;
+
+    // Deduplicates pipelines and the objects they are built from. Equivalent requests return the same
+    // shader module/set layout/pipeline, so identical handles in turn make equivalent PipelineConfigs compare equal.
+    // All methods are thread-safe.
+    class PipelineCache
+    {
+    public:
+        PipelineCache(const Device &device, ThreadPool &threadPool);
+        PipelineCache(const PipelineCache &other) = delete;
+        PipelineCache(PipelineCache &&other) = delete;
+        ~PipelineCache();
+
+        auto operator=(const PipelineCache &other) -> PipelineCache& = delete;
+        auto operator=(PipelineCache &&other) -> PipelineCache& = delete;
+
+        auto getShader(const std::vector<uint32_t> &spirv) -> VkShaderModule;
+        auto getDescriptorSetLayout(const DescriptorSetLayoutBuilder &builder) -> VkDescriptorSetLayout;
+
+        // One layout per set declared by the shaders, indexed by set number. Sets the shaders skip get empty layouts.
+        auto getDescriptorSetLayouts(const ShaderReflection &reflection) -> std::vector<VkDescriptorSetLayout>;
+
+        // Compiles on the calling thread if the pipeline is not yet known
+        auto getPipeline(VkRenderPass renderPass, const PipelineConfig &config) -> sptr<Pipeline>;
+
+        // Queues compilation on the thread pool. Shader modules and set layouts referenced by the config
+        // must stay alive until the future is ready, which is guaranteed for ones obtained from this cache.
+        auto getPipelineAsync(VkRenderPass renderPass, const PipelineConfig &config) -> std::shared_future<sptr<Pipeline>>;
+
+        // Blocks until all queued pipelines are compiled
+        void wait();
+
+        auto getPipelineCount() const -> uint32_t;
+        auto getPipelineRequestCount() const -> uint32_t;
+
+    private:
+        struct PipelineKey
+        {
+            VkRenderPass renderPass;
+            PipelineConfig config;
+
+            bool operator==(const PipelineKey &other) const
+            {
+                return renderPass == other.renderPass && config == other.config;
+            }
+        };
+
+        struct PipelineKeyHash
+        {
+            auto operator()(const PipelineKey &key) const -> size_t;
+        };
+
+        struct LayoutBindingLess
+        {
+            bool operator()(const std::vector<VkDescriptorSetLayoutBinding> &a, const std::vector<VkDescriptorSetLayoutBinding> &b) const;
+        };
+
+        const Device &device;
+        ThreadPool &threadPool;
+        mutable std::mutex mutex;
+        std::map<std::vector<uint32_t>, Resource<VkShaderModule>> shaders;
+        std::map<std::vector<VkDescriptorSetLayoutBinding>, Resource<VkDescriptorSetLayout>, LayoutBindingLess> setLayouts;
+        std::unordered_map<PipelineKey, std::shared_future<sptr<Pipeline>>, PipelineKeyHash> pipelines;
+        uint32_t pipelineRequests = 0;
+    };
+
+    // Variants of one pipeline that differ only in boolean specialization constants. Bit i of a feature mask
+    // drives the constant with id (firstConstantId + i), so shaders can branch on features that get folded
+    // away by the driver instead of being evaluated per-fragment. Variants go through the PipelineCache,
+    // so each distinct mask is compiled once.
+    class PipelinePermutations
+    {
+    public:
+        PipelinePermutations() {}
+        PipelinePermutations(PipelineCache &cache, VkRenderPass renderPass, const PipelineConfig &baseConfig,
+            VkShaderStageFlags stages, uint32_t featureCount, uint32_t firstConstantId = 0);
+
+        auto get(uint32_t featureMask) -> std::shared_future<sptr<Pipeline>>;
+
+        // Queues compilation of the given variants so that switching to them later does not stall
+        void prewarm(const std::vector<uint32_t> &featureMasks);
+
+        auto getFeatureCount() const -> uint32_t { return featureCount; }
+
+    private:
+        PipelineCache *cache = nullptr;
+        VkRenderPass renderPass = nullptr;
+        PipelineConfig baseConfig{nullptr, nullptr};
+        VkShaderStageFlags stages = 0;
+        uint32_t featureCount = 0;
+        uint32_t firstConstantId = 0;
+        std::unordered_map<uint32_t, std::shared_future<sptr<Pipeline>>> variants;
+    };
+}
@@ -0,0 +1,119 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanQueueScheduler.h"
+
+vk::QueueScheduler::QueueScheduler(VkDevice device, uint32_t frameCount):
+    device(device),
+    slots(frameCount)
+{
+}
+
+void vk::QueueScheduler::beginFrame(uint32_t frameIndex)
+{
+    this->frameIndex = frameIndex;
+    work.clear();
+
+    // Each queue used in the frame signaled a fence after its last work, once they're all signaled every semaphore
+    // of the slot has been waited on and can be signaled again
+    auto &slot = slots[frameIndex];
+    if (slot.usedFenceCount)
+    {
+        std::vector<VkFence> fences;
+        for (uint32_t i = 0; i < slot.usedFenceCount; i++)
+            fences.push_back(slot.fences[i]);
+        KL_VK_CHECK_RESULT(vkWaitForFences(device, slot.usedFenceCount, fences.data(), VK_TRUE, UINT64_MAX));
+        KL_VK_CHECK_RESULT(vkResetFences(device, slot.usedFenceCount, fences.data()));
+    }
+
+    slot.usedSemaphoreCount = 0;
+    slot.usedFenceCount = 0;
+}
+
+auto vk::QueueScheduler::addWork(VkQueue queue, VkCommandBuffer commandBuffer) -> uint32_t
+{
+    work.push_back({queue, commandBuffer, {}, {}, {}});
+    return static_cast<uint32_t>(work.size() - 1);
+}
+
+void vk::QueueScheduler::addDependency(uint32_t work, uint32_t dependsOn, VkPipelineStageFlags waitStages)
+{
+    // Waiting on a semaphore whose signal hasn't been submitted yet could stall the queue for good, so such a
+    // dependency is dropped even where panics are compiled out
+    if (work >= this->work.size() || dependsOn >= work)
+    {
+        KL_PANIC("Work can only depend on work added before it");
+        return;
+    }
+
+    const auto semaphore = acquireSemaphore();
+    this->work[dependsOn].signalSemaphores.push_back(semaphore);
+    addWait(work, semaphore, waitStages);
+}
+
+void vk::QueueScheduler::addWait(uint32_t work, VkSemaphore semaphore, VkPipelineStageFlags waitStages)
+{
+    this->work[work].waitSemaphores.push_back(semaphore);
+    this->work[work].waitStages.push_back(waitStages);
+}
+
+void vk::QueueScheduler::addSignal(uint32_t work, VkSemaphore semaphore)
+{
+    this->work[work].signalSemaphores.push_back(semaphore);
+}
+
+void vk::QueueScheduler::submit()
+{
+    std::vector<VkSubmitInfo> submitInfos;
+
+    for (size_t first = 0; first < work.size();)
+    {
+        const auto queue = work[first].queue;
+
+        submitInfos.clear();
+        auto last = first;
+        for (; last < work.size() && work[last].queue == queue; last++)
+        {
+            const auto &w = work[last];
+            VkSubmitInfo info{};
+            info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            info.waitSemaphoreCount = static_cast<uint32_t>(w.waitSemaphores.size());
+            info.pWaitSemaphores = w.waitSemaphores.data();
+            info.pWaitDstStageMask = w.waitStages.data();
+            info.commandBufferCount = 1;
+            info.pCommandBuffers = &w.commandBuffer;
+            info.signalSemaphoreCount = static_cast<uint32_t>(w.signalSemaphores.size());
+            info.pSignalSemaphores = w.signalSemaphores.data();
+            submitInfos.push_back(info);
+        }
+
+        auto lastOnQueue = true;
+        for (auto i = last; i < work.size() && lastOnQueue; i++)
+            lastOnQueue = work[i].queue != queue;
+
+        const auto fence = lastOnQueue ? acquireFence() : VK_NULL_HANDLE;
+        KL_VK_CHECK_RESULT(vkQueueSubmit(queue, static_cast<uint32_t>(submitInfos.size()), submitInfos.data(), fence));
+
+        first = last;
+    }
+
+    work.clear();
+}
+
+auto vk::QueueScheduler::acquireSemaphore() -> VkSemaphore
+{
+    auto &slot = slots[frameIndex];
+    if (slot.usedSemaphoreCount == slot.semaphores.size())
+        slot.semaphores.push_back(createSemaphore(device));
+    return slot.semaphores[slot.usedSemaphoreCount++];
+}
+
+auto vk::QueueScheduler::acquireFence() -> VkFence
+{
+    auto &slot = slots[frameIndex];
+    if (slot.usedFenceCount == slot.fences.size())
+        slot.fences.push_back(createFence(device, false));
+    return slot.fences[slot.usedFenceCount++];
+}
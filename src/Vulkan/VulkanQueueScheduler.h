@@ -0,0 +1,66 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include <vector>
+
+namespace vk
+{
+    // Submissions of a frame spread over several queues, e.g. graphics and async compute, ordered by semaphores so
+    // that independent work on different queues overlaps. Work is submitted in the order it's added, consecutive work
+    // on the same queue in one vkQueueSubmit. Semaphores between work and fences come from pools per frame slot,
+    // beginFrame() waits for the previous submissions of the slot before reusing them. Not thread-safe.
+    class QueueScheduler
+    {
+    public:
+        QueueScheduler() {}
+        QueueScheduler(VkDevice device, uint32_t frameCount);
+        QueueScheduler(const QueueScheduler &other) = delete;
+        QueueScheduler(QueueScheduler &&other) = default;
+        ~QueueScheduler() {}
+
+        auto operator=(const QueueScheduler &other) -> QueueScheduler& = delete;
+        auto operator=(QueueScheduler &&other) -> QueueScheduler& = default;
+
+        void beginFrame(uint32_t frameIndex);
+
+        auto addWork(VkQueue queue, VkCommandBuffer commandBuffer) -> uint32_t;
+        // The work waits at these stages until the earlier work completes
+        void addDependency(uint32_t work, uint32_t dependsOn, VkPipelineStageFlags waitStages);
+        // Semaphores from outside, e.g. of the swapchain
+        void addWait(uint32_t work, VkSemaphore semaphore, VkPipelineStageFlags waitStages);
+        void addSignal(uint32_t work, VkSemaphore semaphore);
+
+        void submit();
+
+    private:
+        struct Work
+        {
+            VkQueue queue;
+            VkCommandBuffer commandBuffer;
+            std::vector<VkSemaphore> waitSemaphores;
+            std::vector<VkPipelineStageFlags> waitStages;
+            std::vector<VkSemaphore> signalSemaphores;
+        };
+
+        struct FrameSlot
+        {
+            std::vector<Resource<VkSemaphore>> semaphores;
+            uint32_t usedSemaphoreCount = 0;
+            std::vector<Resource<VkFence>> fences;
+            uint32_t usedFenceCount = 0;
+        };
+
+        VkDevice device = nullptr;
+        std::vector<FrameSlot> slots;
+        uint32_t frameIndex = 0;
+        std::vector<Work> work;
+
+        auto acquireSemaphore() -> VkSemaphore;
+        auto acquireFence() -> VkFence;
+    };
+}
@@ -0,0 +1,515 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanRenderGraph.h"
+#include "VulkanDevice.h"
+#include <algorithm>
+
+static const uint32_t none = UINT32_MAX;
+
+auto vk::RenderGraphPass::withColorOutput(uint32_t image, bool clear, VkClearColorValue clearValue) -> RenderGraphPass&
+{
+    VkClearValue value;
+    value.color = clearValue;
+    accesses.push_back({image, Usage::Color, clear, value, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT});
+    return *this;
+}
+
+auto vk::RenderGraphPass::withDepthOutput(uint32_t image, bool clear, VkClearDepthStencilValue clearValue) -> RenderGraphPass&
+{
+    VkClearValue value;
+    value.depthStencil = clearValue;
+    accesses.push_back({image, Usage::Depth, clear, value,
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT});
+    return *this;
+}
+
+auto vk::RenderGraphPass::withTextureInput(uint32_t image, VkPipelineStageFlags stages) -> RenderGraphPass&
+{
+    accesses.push_back({image, Usage::Texture, false, {}, stages});
+    return *this;
+}
+
+auto vk::RenderGraphPass::withSecondaryCommandBuffers() -> RenderGraphPass&
+{
+    contents = VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
+    return *this;
+}
+
+auto vk::RenderGraphPass::withExecute(Execute execute) -> RenderGraphPass&
+{
+    this->execute = std::move(execute);
+    return *this;
+}
+
+vk::RenderGraph::RenderGraph(const Device &device):
+    device(device),
+    allocator(&device.getMemoryAllocator())
+{
+}
+
+auto vk::RenderGraph::addImage(uint32_t width, uint32_t height, VkFormat format, VkImageAspectFlags aspectMask) -> uint32_t
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.format = format;
+    image.aspectMask = aspectMask;
+    images.push_back(std::move(image));
+    return static_cast<uint32_t>(images.size() - 1);
+}
+
+void vk::RenderGraph::exportImage(uint32_t image, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stages)
+{
+    auto &img = images[image];
+    img.exported = true;
+    img.exportLayout = layout;
+    img.exportAccess = access;
+    img.exportStages = stages;
+}
+
+auto vk::RenderGraph::addPass(const RenderGraphPass &pass) -> uint32_t
+{
+    Pass p;
+    p.desc = pass;
+    passes.push_back(std::move(p));
+    return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void vk::RenderGraph::compile()
+{
+    cull();
+
+    std::vector<uint32_t> firstUse(images.size(), none);
+    std::vector<uint32_t> lastUse(images.size(), none);
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        if (passes[i].culled)
+            continue;
+        for (const auto &access: passes[i].desc.accesses)
+        {
+            KL_PANIC_IF(firstUse[access.image] == none && access.usage == RenderGraphPass::Usage::Texture,
+                "Render graph image is read before being written");
+            if (firstUse[access.image] == none)
+                firstUse[access.image] = i;
+            lastUse[access.image] = i;
+        }
+    }
+
+    std::vector<uint32_t> previousOccupant;
+    createImages(firstUse, lastUse, previousOccupant);
+
+    for (uint32_t i = 0; i < passes.size(); i++)
+    {
+        if (!passes[i].culled)
+            createRenderPass(passes[i], firstUse, lastUse, i);
+    }
+
+    createBarriers(previousOccupant);
+}
+
+void vk::RenderGraph::execute(VkCommandBuffer buf) const
+{
+    auto recordBarriers = [&](uint32_t batchIndex)
+    {
+        const auto &batch = barrierBatches[batchIndex];
+        vkCmdPipelineBarrier(buf, batch.srcStages, batch.dstStages, 0, 0, nullptr, 0, nullptr,
+            batch.barriers.size(), batch.barriers.data());
+    };
+
+    for (const auto &pass: passes)
+    {
+        if (pass.culled)
+            continue;
+
+        if (pass.barrierBatch != none)
+            recordBarriers(pass.barrierBatch);
+
+        VkRenderPassBeginInfo info{};
+        info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        info.renderPass = pass.renderPass;
+        info.framebuffer = pass.framebuffer;
+        info.renderArea.extent.width = pass.width;
+        info.renderArea.extent.height = pass.height;
+        info.clearValueCount = pass.clearValues.size();
+        info.pClearValues = pass.clearValues.data();
+        vkCmdBeginRenderPass(buf, &info, pass.desc.contents);
+
+        if (pass.desc.execute)
+            pass.desc.execute(buf, {pass.renderPass, pass.framebuffer, pass.width, pass.height});
+
+        vkCmdEndRenderPass(buf);
+    }
+
+    if (exportBarrierBatch != none)
+        recordBarriers(exportBarrierBatch);
+}
+
+void vk::RenderGraph::cull()
+{
+    // Walking backwards, a pass is needed if it writes contents that are exported or used by a later needed pass.
+    // Clearing makes earlier contents of the image irrelevant to the passes after it.
+    std::vector<bool> needed(images.size(), false);
+    for (uint32_t i = 0; i < images.size(); i++)
+        needed[i] = images[i].exported;
+
+    for (auto pass = passes.rbegin(); pass != passes.rend(); ++pass)
+    {
+        const auto &accesses = pass->desc.accesses;
+        pass->culled = std::none_of(accesses.begin(), accesses.end(), [&](const RenderGraphPass::Access &access)
+        {
+            return access.usage != RenderGraphPass::Usage::Texture && needed[access.image];
+        });
+        if (pass->culled)
+        {
+            stats.culledPassCount++;
+            continue;
+        }
+
+        for (const auto &access: accesses)
+        {
+            if (access.clear)
+                needed[access.image] = false;
+        }
+        for (const auto &access: accesses)
+        {
+            if (!access.clear)
+                needed[access.image] = true;
+        }
+    }
+
+    stats.passCount = passes.size() - stats.culledPassCount;
+}
+
+void vk::RenderGraph::createImages(const std::vector<uint32_t> &firstUse, const std::vector<uint32_t> &lastUse,
+    std::vector<uint32_t> &previousOccupant)
+{
+    std::vector<VkImageUsageFlags> usage(images.size(), 0);
+    for (const auto &pass: passes)
+    {
+        if (pass.culled)
+            continue;
+        for (const auto &access: pass.desc.accesses)
+        {
+            switch (access.usage)
+            {
+                case RenderGraphPass::Usage::Color:
+                    usage[access.image] |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                    break;
+                case RenderGraphPass::Usage::Depth:
+                    usage[access.image] |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                    break;
+                case RenderGraphPass::Usage::Texture:
+                    usage[access.image] |= VK_IMAGE_USAGE_SAMPLED_BIT;
+                    break;
+            }
+        }
+    }
+
+    std::vector<VkMemoryRequirements> requirements(images.size());
+    std::vector<uint32_t> created;
+    for (uint32_t i = 0; i < images.size(); i++)
+    {
+        auto &image = images[i];
+        if (firstUse[i] == none)
+            continue;
+
+        if (image.exportLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+            usage[i] |= VK_IMAGE_USAGE_SAMPLED_BIT;
+        else if (image.exportLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+            usage[i] |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = image.format;
+        imageInfo.extent = {image.width, image.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = usage[i];
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        image.image = Resource<VkImage>{device};
+        KL_VK_CHECK_RESULT(vkCreateImage(device, &imageInfo, nullptr, image.image.cleanRef()));
+        vkGetImageMemoryRequirements(device, image.image, &requirements[i]);
+
+        created.push_back(i);
+        stats.imageBytes += requirements[i].size;
+    }
+
+    // Largest first, each image joins the first group none of whose images is alive at the same time.
+    // Exported images are alive across frames and get memory of their own.
+    std::stable_sort(created.begin(), created.end(), [&](uint32_t a, uint32_t b)
+    {
+        return requirements[a].size > requirements[b].size;
+    });
+
+    struct Group
+    {
+        VkMemoryRequirements requirements;
+        std::vector<uint32_t> images;
+        bool exported;
+    };
+    std::vector<Group> groups;
+
+    for (const auto i: created)
+    {
+        const auto &reqs = requirements[i];
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const Group &group)
+        {
+            if (group.exported || images[i].exported || !(group.requirements.memoryTypeBits & reqs.memoryTypeBits))
+                return false;
+            return std::none_of(group.images.begin(), group.images.end(), [&](uint32_t other)
+            {
+                return firstUse[i] <= lastUse[other] && firstUse[other] <= lastUse[i];
+            });
+        });
+
+        if (group == groups.end())
+        {
+            groups.push_back({reqs, {i}, images[i].exported});
+            continue;
+        }
+
+        group->requirements.size = (std::max)(group->requirements.size, reqs.size);
+        group->requirements.alignment = (std::max)(group->requirements.alignment, reqs.alignment);
+        group->requirements.memoryTypeBits &= reqs.memoryTypeBits;
+        group->images.push_back(i);
+    }
+
+    previousOccupant.assign(images.size(), none);
+    for (auto &group: groups)
+    {
+        // Render targets get their own memory, as in Image
+        auto allocation = allocator->allocate(group.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, true);
+        stats.allocatedBytes += group.requirements.size;
+
+        // In the order images take over the memory during the frame, the first one after the last one of the previous frame
+        std::sort(group.images.begin(), group.images.end(), [&](uint32_t a, uint32_t b) { return firstUse[a] < firstUse[b]; });
+        for (uint32_t j = 0; j < group.images.size(); j++)
+        {
+            const auto i = group.images[j];
+            auto &image = images[i];
+            KL_VK_CHECK_RESULT(vkBindImageMemory(device, image.image, allocation.getMemory(), allocation.getOffset()));
+            image.view = createImageView(device, image.format, VK_IMAGE_VIEW_TYPE_2D, 1, 1, image.image, image.aspectMask);
+            previousOccupant[i] = group.images[(j + group.images.size() - 1) % group.images.size()];
+        }
+
+        memory.push_back(std::move(allocation));
+    }
+
+    stats.imageCount = created.size();
+}
+
+void vk::RenderGraph::createRenderPass(Pass &pass, const std::vector<uint32_t> &firstUse,
+    const std::vector<uint32_t> &lastUse, uint32_t passIndex)
+{
+    // Contents are stored only if something reads them later in the frame or they're exported
+    auto isKept = [&](uint32_t image)
+    {
+        if (lastUse[image] > passIndex)
+        {
+            for (auto i = passIndex + 1; i < passes.size(); i++)
+            {
+                if (passes[i].culled)
+                    continue;
+                for (const auto &access: passes[i].desc.accesses)
+                {
+                    if (access.image == image)
+                        return access.usage == RenderGraphPass::Usage::Texture || !access.clear;
+                }
+            }
+        }
+        return images[image].exported;
+    };
+
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<VkAttachmentReference> colorRefs;
+    VkAttachmentReference depthRef{VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+    std::vector<VkImageView> views;
+
+    for (const auto &access: pass.desc.accesses)
+    {
+        if (access.usage == RenderGraphPass::Usage::Texture)
+            continue;
+
+        const auto &image = images[access.image];
+        const auto depth = access.usage == RenderGraphPass::Usage::Depth;
+        const auto layout = depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        KL_PANIC_IF(depth && depthRef.attachment != VK_ATTACHMENT_UNUSED, "Render graph pass has more than one depth output");
+
+        // Layouts don't change within the pass, barriers before it take care of transitions
+        VkAttachmentDescription desc{};
+        desc.format = image.format;
+        desc.samples = VK_SAMPLE_COUNT_1_BIT;
+        desc.loadOp = access.clear
+            ? VK_ATTACHMENT_LOAD_OP_CLEAR
+            : (firstUse[access.image] == passIndex ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD);
+        desc.storeOp = isKept(access.image) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        const auto stencil = (image.aspectMask & VK_IMAGE_ASPECT_STENCIL_BIT) != 0;
+        desc.stencilLoadOp = stencil ? desc.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        desc.stencilStoreOp = stencil ? desc.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        desc.initialLayout = layout;
+        desc.finalLayout = layout;
+
+        const VkAttachmentReference ref{static_cast<uint32_t>(attachments.size()), layout};
+        if (depth)
+            depthRef = ref;
+        else
+            colorRefs.push_back(ref);
+
+        attachments.push_back(desc);
+        views.push_back(image.view);
+        pass.clearValues.push_back(access.clearValue);
+        pass.width = image.width;
+        pass.height = image.height;
+    }
+
+    KL_PANIC_IF(attachments.empty(), "Render graph pass has no outputs");
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = colorRefs.size();
+    subpass.pColorAttachments = colorRefs.data();
+    subpass.pDepthStencilAttachment = depthRef.attachment != VK_ATTACHMENT_UNUSED ? &depthRef : nullptr;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = attachments.size();
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    pass.renderPass = Resource<VkRenderPass>{device};
+    KL_VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, pass.renderPass.cleanRef()));
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = pass.renderPass;
+    framebufferInfo.attachmentCount = views.size();
+    framebufferInfo.pAttachments = views.data();
+    framebufferInfo.width = pass.width;
+    framebufferInfo.height = pass.height;
+    framebufferInfo.layers = 1;
+
+    pass.framebuffer = Resource<VkFramebuffer>{device};
+    KL_VK_CHECK_RESULT(vkCreateFramebuffer(device, &framebufferInfo, nullptr, pass.framebuffer.cleanRef()));
+}
+
+void vk::RenderGraph::createBarriers(const std::vector<uint32_t> &previousOccupant)
+{
+    // Brings the image into the new state. Reads that the last write is already visible to need nothing,
+    // everything else waits for the last write and, if it writes or transitions, for the reads since.
+    auto transition = [&](BarrierBatch &batch, ImageState &state, uint32_t image, VkImageLayout layout,
+        VkAccessFlags access, VkPipelineStageFlags stages, bool write)
+    {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = images[image].image;
+        barrier.subresourceRange = {images[image].aspectMask, 0, 1, 0, 1};
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = layout;
+        barrier.srcAccessMask = state.writeAccess;
+        barrier.dstAccessMask = access;
+
+        VkPipelineStageFlags srcStages;
+        if (state.layout != layout || write)
+        {
+            srcStages = state.writeStages | state.readStages;
+            state = write
+                ? ImageState{layout, stages, access, 0, 0}
+                : ImageState{layout, stages, 0, stages, access};
+        }
+        else if ((stages & ~state.readStages) || (access & ~state.readAccess))
+        {
+            srcStages = state.writeStages;
+            state.readStages |= stages;
+            state.readAccess |= access;
+        }
+        else
+            return;
+
+        batch.srcStages |= srcStages ? srcStages : VkPipelineStageFlags(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        batch.dstStages |= stages;
+        batch.barriers.push_back(barrier);
+    };
+
+    // Returns the states at the end of the frame
+    auto simulate = [&](std::vector<ImageState> states, bool record)
+    {
+        for (auto &pass: passes)
+        {
+            if (pass.culled)
+                continue;
+
+            BarrierBatch batch;
+            for (const auto &access: pass.desc.accesses)
+            {
+                auto &state = states[access.image];
+                switch (access.usage)
+                {
+                    case RenderGraphPass::Usage::Color:
+                        transition(batch, state, access.image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, access.stages, true);
+                        break;
+                    case RenderGraphPass::Usage::Depth:
+                        transition(batch, state, access.image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, access.stages, true);
+                        break;
+                    case RenderGraphPass::Usage::Texture:
+                        transition(batch, state, access.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            VK_ACCESS_SHADER_READ_BIT, access.stages, false);
+                        break;
+                }
+            }
+
+            if (record && !batch.barriers.empty())
+            {
+                pass.barrierBatch = barrierBatches.size();
+                barrierBatches.push_back(std::move(batch));
+            }
+        }
+
+        BarrierBatch batch;
+        for (uint32_t i = 0; i < images.size(); i++)
+        {
+            const auto &image = images[i];
+            if (image.exported && image.image)
+                transition(batch, states[i], i, image.exportLayout, image.exportAccess, image.exportStages, false);
+        }
+        if (record && !batch.barriers.empty())
+        {
+            exportBarrierBatch = barrierBatches.size();
+            barrierBatches.push_back(std::move(batch));
+        }
+
+        return states;
+    };
+
+    // Every image starts the frame with undefined contents, after whatever used its memory last. That's the image
+    // before it in the same memory or, for the first one, the last one in the previous frame.
+    const ImageState undefined{VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0};
+    const auto endStates = simulate(std::vector<ImageState>(images.size(), undefined), false);
+
+    std::vector<ImageState> startStates(images.size(), undefined);
+    for (uint32_t i = 0; i < images.size(); i++)
+    {
+        if (previousOccupant[i] != none)
+        {
+            startStates[i] = endStates[previousOccupant[i]];
+            startStates[i].layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+    }
+    simulate(startStates, true);
+
+    for (const auto &batch: barrierBatches)
+        stats.barrierCount += batch.barriers.size();
+    stats.barrierBatchCount = barrierBatches.size();
+}
@@ -0,0 +1,166 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include <vector>
+#include <functional>
+
+namespace vk
+{
+    class Device;
+
+    // What a pass gets to record its commands with
+    struct RenderGraphPassContext
+    {
+        VkRenderPass renderPass;
+        VkFramebuffer framebuffer;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Declares the images a pass renders to and samples. The pass is recorded as one render pass with one subpass.
+    class RenderGraphPass
+    {
+    public:
+        using Execute = std::function<void(VkCommandBuffer buf, const RenderGraphPassContext &context)>;
+
+        // Without clearing previous contents are kept, an image must be written before it's kept or read in a frame
+        auto withColorOutput(uint32_t image, bool clear, VkClearColorValue clearValue = {}) -> RenderGraphPass&;
+        auto withDepthOutput(uint32_t image, bool clear, VkClearDepthStencilValue clearValue = {}) -> RenderGraphPass&;
+        auto withTextureInput(uint32_t image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) -> RenderGraphPass&;
+        // Commands of the pass are executed from secondary command buffers
+        auto withSecondaryCommandBuffers() -> RenderGraphPass&;
+        auto withExecute(Execute execute) -> RenderGraphPass&;
+
+    private:
+        friend class RenderGraph;
+
+        enum class Usage
+        {
+            Color,
+            Depth,
+            Texture
+        };
+
+        struct Access
+        {
+            uint32_t image;
+            Usage usage;
+            bool clear;
+            VkClearValue clearValue;
+            VkPipelineStageFlags stages;
+        };
+
+        std::vector<Access> accesses;
+        VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE;
+        Execute execute;
+    };
+
+    struct RenderGraphStats
+    {
+        uint32_t passCount = 0;
+        uint32_t culledPassCount = 0;
+        uint32_t imageCount = 0; // created, images used by culled passes only aren't
+        VkDeviceSize imageBytes = 0; // what the images would take without aliasing
+        VkDeviceSize allocatedBytes = 0;
+        uint32_t barrierCount = 0; // image barriers per frame
+        uint32_t barrierBatchCount = 0; // vkCmdPipelineBarrier calls per frame
+    };
+
+    // Frame of render passes described by what they read and write. compile() drops passes that contribute nothing
+    // to exported images, derives load/store ops and the layout transitions and dependencies between passes, and
+    // places images whose lifetimes don't overlap in the same memory. Barriers are worked out once and recorded in one
+    // batch before each pass that needs them. Passes are executed in the order they're added.
+    // Contents of images are undefined at the start of every frame, exported ones keep theirs until the next frame
+    // writes them, so that work outside the graph can use them. Not thread-safe.
+    class RenderGraph
+    {
+    public:
+        RenderGraph() {}
+        explicit RenderGraph(const Device &device);
+        RenderGraph(const RenderGraph &other) = delete;
+        RenderGraph(RenderGraph &&other) = default;
+        ~RenderGraph() {}
+
+        auto operator=(const RenderGraph &other) -> RenderGraph& = delete;
+        auto operator=(RenderGraph &&other) -> RenderGraph& = default;
+
+        auto addImage(uint32_t width, uint32_t height, VkFormat format, VkImageAspectFlags aspectMask) -> uint32_t;
+        // The image is left in this state at the end of the frame, for use by later work on the same queue
+        void exportImage(uint32_t image, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stages);
+        auto addPass(const RenderGraphPass &pass) -> uint32_t;
+
+        void compile();
+        void execute(VkCommandBuffer buf) const;
+
+        // After compile(), null for culled passes and images not created
+        auto getRenderPass(uint32_t pass) const -> VkRenderPass { return passes[pass].renderPass; }
+        auto getImage(uint32_t image) const -> VkImage { return images[image].image; }
+        auto getImageView(uint32_t image) const -> VkImageView { return images[image].view; }
+        auto getStats() const -> RenderGraphStats { return stats; }
+
+    private:
+        struct Image
+        {
+            uint32_t width;
+            uint32_t height;
+            VkFormat format;
+            VkImageAspectFlags aspectMask;
+            bool exported = false;
+            VkImageLayout exportLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkAccessFlags exportAccess = 0;
+            VkPipelineStageFlags exportStages = 0;
+            Resource<VkImage> image;
+            Resource<VkImageView> view;
+        };
+
+        struct Pass
+        {
+            RenderGraphPass desc;
+            bool culled = false;
+            Resource<VkRenderPass> renderPass;
+            Resource<VkFramebuffer> framebuffer;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            std::vector<VkClearValue> clearValues;
+            uint32_t barrierBatch = UINT32_MAX; // recorded before the pass
+        };
+
+        // Synchronization state of an image as of the commands recorded so far
+        struct ImageState
+        {
+            VkImageLayout layout;
+            VkPipelineStageFlags writeStages; // of the last write or layout transition
+            VkAccessFlags writeAccess;
+            VkPipelineStageFlags readStages; // the last write has been made visible to these
+            VkAccessFlags readAccess;
+        };
+
+        struct BarrierBatch
+        {
+            VkPipelineStageFlags srcStages = 0;
+            VkPipelineStageFlags dstStages = 0;
+            std::vector<VkImageMemoryBarrier> barriers;
+        };
+
+        VkDevice device = nullptr;
+        MemoryAllocator *allocator = nullptr;
+        std::vector<Image> images;
+        std::vector<Pass> passes;
+        std::vector<BarrierBatch> barrierBatches;
+        uint32_t exportBarrierBatch = UINT32_MAX; // recorded after the last pass
+        std::vector<Allocation> memory; // one per group of images sharing memory
+        RenderGraphStats stats;
+
+        void cull();
+        void createImages(const std::vector<uint32_t> &firstUse, const std::vector<uint32_t> &lastUse,
+            std::vector<uint32_t> &previousOccupant);
+        void createRenderPass(Pass &pass, const std::vector<uint32_t> &firstUse, const std::vector<uint32_t> &lastUse, uint32_t passIndex);
+        void createBarriers(const std::vector<uint32_t> &previousOccupant);
+    };
+}
@@ -54,13 +54,14 @@ vk::RenderPass::RenderPass(VkDevice device, const RenderPassConfig &config):
     renderPassInfo.dependencyCount = dependencies.size();
     renderPassInfo.pDependencies = dependencies.data();
 
-    Resource<VkRenderPass> pass{device, vkDestroyRenderPass};
+    Resource<VkRenderPass> pass{device};
     KL_VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, pass.cleanRef()));
 
     this->pass = std::move(pass);
 }
 
-void vk::RenderPass::begin(VkCommandBuffer cmdBuf, VkFramebuffer framebuffer, uint32_t canvasWidth, uint32_t canvasHeight)
+void vk::RenderPass::begin(VkCommandBuffer cmdBuf, VkFramebuffer framebuffer, uint32_t canvasWidth, uint32_t canvasHeight,
+    VkSubpassContents contents)
 {
     VkRenderPassBeginInfo info{};
     info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -74,7 +75,7 @@ void vk::RenderPass::begin(VkCommandBuffer cmdBuf, VkFramebuffer framebuffer, ui
 	info.pClearValues = clearValues.data();
     info.framebuffer = framebuffer;
 
-    vkCmdBeginRenderPass(cmdBuf, &info, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(cmdBuf, &info, contents);
 }
 
 void vk::RenderPass::end(VkCommandBuffer cmdBuf)
@@ -40,7 +40,8 @@ namespace vk
         auto operator=(const RenderPass &other) -> RenderPass& = delete;
         auto operator=(RenderPass &&other) -> RenderPass& = default;
 
-        void begin(VkCommandBuffer cmdBuf, VkFramebuffer framebuffer, uint32_t canvasWidth, uint32_t canvasHeight);
+        void begin(VkCommandBuffer cmdBuf, VkFramebuffer framebuffer, uint32_t canvasWidth, uint32_t canvasHeight,
+            VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
         void end(VkCommandBuffer cmdBuf);
 
         operator VkRenderPass() { return pass; }
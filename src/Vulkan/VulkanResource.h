@@ -9,15 +9,102 @@
 #   define VK_USE_PLATFORM_WIN32_KHR
 #endif
 #include <vulkan.h>
-#include <functional>
+#include <utility>
+#include <cstdint>
 #include <cassert>
+#include <type_traits>
 
 namespace vk
 {
+    // Deleters are picked by handle type, which needs the handle types to be distinct. They are all uint64_t in
+    // 32-bit builds.
+    static_assert(!std::is_same<VkBuffer, VkImage>::value, "Resource requires a 64-bit build");
+
+    // How handles of type T are destroyed, specialised per handle type. Owner is the instance or device the handle
+    // was created from, void* for instances and devices themselves.
+    template <class T>
+    struct DeleterTraits;
+
+#define KL_STANDALONE_DELETER(Handle, func) \
+    template <> \
+    struct DeleterTraits<Handle> \
+    { \
+        using Owner = void*; \
+        static void destroy(void*, Handle handle) { func(handle, nullptr); } \
+    };
+
+#define KL_INSTANCE_DELETER(Handle, func) \
+    template <> \
+    struct DeleterTraits<Handle> \
+    { \
+        using Owner = VkInstance; \
+        static void destroy(VkInstance instance, Handle handle) { func(instance, handle, nullptr); } \
+    };
+
+#define KL_DEVICE_DELETER(Handle, func) \
+    template <> \
+    struct DeleterTraits<Handle> \
+    { \
+        using Owner = VkDevice; \
+        static void destroy(VkDevice device, Handle handle) { func(device, handle, nullptr); } \
+    };
+
+    KL_STANDALONE_DELETER(VkInstance, vkDestroyInstance)
+    KL_STANDALONE_DELETER(VkDevice, vkDestroyDevice)
+    KL_INSTANCE_DELETER(VkSurfaceKHR, vkDestroySurfaceKHR)
+    KL_DEVICE_DELETER(VkSwapchainKHR, vkDestroySwapchainKHR)
+    KL_DEVICE_DELETER(VkDeviceMemory, vkFreeMemory)
+    KL_DEVICE_DELETER(VkBuffer, vkDestroyBuffer)
+    KL_DEVICE_DELETER(VkImage, vkDestroyImage)
+    KL_DEVICE_DELETER(VkImageView, vkDestroyImageView)
+    KL_DEVICE_DELETER(VkSampler, vkDestroySampler)
+    KL_DEVICE_DELETER(VkSemaphore, vkDestroySemaphore)
+    KL_DEVICE_DELETER(VkFence, vkDestroyFence)
+    KL_DEVICE_DELETER(VkQueryPool, vkDestroyQueryPool)
+    KL_DEVICE_DELETER(VkCommandPool, vkDestroyCommandPool)
+    KL_DEVICE_DELETER(VkShaderModule, vkDestroyShaderModule)
+    KL_DEVICE_DELETER(VkPipelineCache, vkDestroyPipelineCache)
+    KL_DEVICE_DELETER(VkPipelineLayout, vkDestroyPipelineLayout)
+    KL_DEVICE_DELETER(VkPipeline, vkDestroyPipeline)
+    KL_DEVICE_DELETER(VkRenderPass, vkDestroyRenderPass)
+    KL_DEVICE_DELETER(VkFramebuffer, vkDestroyFramebuffer)
+    KL_DEVICE_DELETER(VkDescriptorSetLayout, vkDestroyDescriptorSetLayout)
+    KL_DEVICE_DELETER(VkDescriptorPool, vkDestroyDescriptorPool)
+
+#undef KL_STANDALONE_DELETER
+#undef KL_INSTANCE_DELETER
+#undef KL_DEVICE_DELETER
+
+    template <>
+    struct DeleterTraits<VkDebugReportCallbackEXT>
+    {
+        using Owner = VkInstance;
+
+        static void destroy(VkInstance instance, VkDebugReportCallbackEXT handle)
+        {
+            // Not exported by the loader
+            const auto destroy = reinterpret_cast<PFN_vkDestroyDebugReportCallbackEXT>(
+                vkGetInstanceProcAddr(instance, "vkDestroyDebugReportCallbackEXT"));
+            destroy(instance, handle, nullptr);
+        }
+    };
+
+    // A handle given up by its Resource, destroyed later by calling destroy(). See DeletionQueue.
+    struct RetiredResource
+    {
+        uint64_t handle;
+        void *owner;
+        void (*destroy)(const RetiredResource &resource);
+    };
+
+    // Owns a handle together with the instance/device it came from, no more than two pointers in size.
+    // The deleter is known from the handle type, see DeleterTraits.
     template <class T>
     class Resource
     {
     public:
+        using Owner = typename DeleterTraits<T>::Owner;
+
         Resource() {}
         Resource(const Resource<T> &other) = delete;
         Resource(Resource<T> &&other) noexcept
@@ -25,24 +112,9 @@ namespace vk
             swap(other);
         }
 
-        explicit Resource(std::function<void(T, VkAllocationCallbacks*)> del)
-        {
-            this->del = [=](T handle) { del(handle, nullptr); };
-        }
-
-        Resource(VkInstance instance, std::function<void(VkInstance, T, VkAllocationCallbacks*)> del)
-        {
-            this->del = [instance, del](T obj) { del(instance, obj, nullptr); };
-        }
-
-        Resource(VkDevice device, std::function<void(VkDevice, T, VkAllocationCallbacks*)> del)
-        {
-            this->del = [device, del](T obj) { del(device, obj, nullptr); };
-        }
-
-        Resource(VkDevice device, VkCommandPool cmdPool, std::function<void(VkDevice, VkCommandPool, uint32_t, T*)> del)
+        explicit Resource(Owner owner):
+            owner(owner)
         {
-            this->del = [device, cmdPool, del](T obj) { del(device, cmdPool, 1, &obj); };
         }
 
         ~Resource()
@@ -73,6 +145,15 @@ namespace vk
             return &handle;
         }
 
+        // Gives up the handle without destroying it, the owner stays so the resource can be reused via cleanRef()
+        auto retire() -> RetiredResource
+        {
+            ensureInitialized();
+            const RetiredResource result{(uint64_t) handle, static_cast<void*>(owner), destroyRetired};
+            handle = VK_NULL_HANDLE;
+            return result;
+        }
+
         operator T() const
         {
             return handle;
@@ -91,27 +172,112 @@ namespace vk
 
     private:
         T handle = VK_NULL_HANDLE;
-        std::function<void(T)> del;
+        Owner owner = nullptr;
+
+        static void destroyRetired(const RetiredResource &resource)
+        {
+            DeleterTraits<T>::destroy(static_cast<Owner>(resource.owner), (T) resource.handle);
+        }
 
         void cleanup()
         {
             if (handle != VK_NULL_HANDLE)
             {
                 ensureInitialized();
-                del(handle);
+                DeleterTraits<T>::destroy(owner, handle);
             }
             handle = VK_NULL_HANDLE;
         }
 
         void ensureInitialized()
         {
-            assert(del /* Calling cleanup() on a Resource with empty deleter */);
+            // Only instances and devices are created without an owner
+            assert((owner || std::is_same<Owner, void*>::value) /* Using a Resource created without its owner */);
         }
 
         void swap(Resource<T> &other) noexcept
         {
             std::swap(handle, other.handle);
-            std::swap(del, other.del);
+            std::swap(owner, other.owner);
+        }
+    };
+
+    // Command buffers are freed to the pool they came from. Keeping them apart spares every other handle the pool.
+    // They're reused rather than dropped while in flight, so they don't go through DeletionQueue.
+    template <>
+    class Resource<VkCommandBuffer>
+    {
+    public:
+        Resource() {}
+        Resource(const Resource<VkCommandBuffer> &other) = delete;
+        Resource(Resource<VkCommandBuffer> &&other) noexcept
+        {
+            swap(other);
+        }
+
+        Resource(VkDevice device, VkCommandPool pool):
+            device(device),
+            pool(pool)
+        {
+        }
+
+        ~Resource()
+        {
+            cleanup();
+        }
+
+        auto operator=(Resource<VkCommandBuffer> other) noexcept -> Resource<VkCommandBuffer>&
+        {
+            swap(other);
+            return *this;
+        }
+
+        auto operator&() const -> const VkCommandBuffer*
+        {
+            return &handle;
+        }
+
+        auto operator&() -> VkCommandBuffer*
+        {
+            return &handle;
+        }
+
+        auto cleanRef() -> VkCommandBuffer*
+        {
+            cleanup();
+            return &handle;
+        }
+
+        operator VkCommandBuffer() const
+        {
+            return handle;
+        }
+
+        operator bool() const
+        {
+            return handle != VK_NULL_HANDLE;
+        }
+
+    private:
+        VkCommandBuffer handle = VK_NULL_HANDLE;
+        VkDevice device = VK_NULL_HANDLE;
+        VkCommandPool pool = VK_NULL_HANDLE;
+
+        void cleanup()
+        {
+            if (handle != VK_NULL_HANDLE)
+            {
+                assert(device && pool /* Using a command buffer Resource created without its pool */);
+                vkFreeCommandBuffers(device, pool, 1, &handle);
+            }
+            handle = VK_NULL_HANDLE;
+        }
+
+        void swap(Resource<VkCommandBuffer> &other) noexcept
+        {
+            std::swap(handle, other.handle);
+            std::swap(device, other.device);
+            std::swap(pool, other.pool);
         }
     };
 }
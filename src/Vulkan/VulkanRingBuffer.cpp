@@ -0,0 +1,44 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanRingBuffer.h"
+#include "VulkanDevice.h"
+#include <algorithm>
+
+static auto alignUp(VkDeviceSize value, VkDeviceSize alignment) -> VkDeviceSize
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+vk::RingBuffer::RingBuffer(const Device &device, VkDeviceSize frameSize, uint32_t frameCount):
+    frameCount(frameCount)
+{
+    const auto &limits = device.getPhysicalProperties().limits;
+    alignment = (std::max)({limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment, VkDeviceSize(1)});
+
+    this->frameSize = alignUp(frameSize, alignment);
+    buffer = Buffer(device, this->frameSize * frameCount,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    data = static_cast<uint8_t*>(buffer.getMappedData());
+    head = frameStart = 0;
+}
+
+void vk::RingBuffer::beginFrame()
+{
+    frameIndex = (frameIndex + 1) % frameCount;
+    head = frameStart = frameIndex * frameSize;
+}
+
+auto vk::RingBuffer::allocate(VkDeviceSize size, void **data) -> uint32_t
+{
+    const auto offset = alignUp(head, alignment);
+    KL_PANIC_IF(offset + size > frameStart + frameSize, "Ring buffer frame is full");
+
+    head = offset + size;
+    *data = this->data + offset;
+
+    return static_cast<uint32_t>(offset);
+}
@@ -0,0 +1,61 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanBuffer.h"
+#include <cstring>
+
+namespace vk
+{
+    class Device;
+
+    // Host-visible uniform/storage buffer split into one region per frame. Data is written straight through the persistent
+    // mapping and bound with dynamic offsets, so per-frame updates are pointer bumps. Writes for the current frame
+    // never touch regions of previous frames, so as long as no more than frameCount frames are in flight the GPU
+    // never reads data being overwritten.
+    class RingBuffer
+    {
+    public:
+        RingBuffer() {}
+        RingBuffer(const Device &device, VkDeviceSize frameSize, uint32_t frameCount);
+        RingBuffer(const RingBuffer &other) = delete;
+        RingBuffer(RingBuffer &&other) = default;
+        ~RingBuffer() {}
+
+        auto operator=(const RingBuffer &other) -> RingBuffer& = delete;
+        auto operator=(RingBuffer &&other) -> RingBuffer& = default;
+
+        // Moves on to the next region, the GPU must be done with the frame that used it last
+        void beginFrame();
+
+        // Returns the dynamic offset of a block aligned for both uniform and storage buffer binding
+        auto allocate(VkDeviceSize size, void **data) -> uint32_t;
+
+        template <class T>
+        auto push(const T &value) -> uint32_t
+        {
+            void *data = nullptr;
+            const auto offset = allocate(sizeof(T), &data);
+            memcpy(data, &value, sizeof(T));
+            return offset;
+        }
+
+        auto getHandle() const -> VkBuffer { return buffer.getHandle(); }
+        auto getFrameSize() const -> VkDeviceSize { return frameSize; }
+        auto getFrameUsage() const -> VkDeviceSize { return head - frameStart; }
+
+    private:
+        Buffer buffer;
+        uint8_t *data = nullptr;
+        VkDeviceSize alignment = 0;
+        VkDeviceSize frameSize = 0;
+        VkDeviceSize frameStart = 0;
+        VkDeviceSize head = 0;
+        uint32_t frameCount = 0;
+        uint32_t frameIndex = 0;
+    };
+}
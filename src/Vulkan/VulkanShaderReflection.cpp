@@ -0,0 +1,397 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanShaderReflection.h"
+#include "VulkanDescriptorSetLayoutBuilder.h"
+#include <spirv.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <tuple>
+
+struct SpirvDecorations
+{
+    uint32_t set = 0;
+    uint32_t binding = 0;
+    uint32_t location = 0;
+    uint32_t offset = 0;
+    uint32_t arrayStride = 0;
+    uint32_t matrixStride = 0;
+    bool hasBinding = false;
+    bool hasLocation = false;
+    bool block = false;
+    bool bufferBlock = false;
+    bool builtIn = false;
+};
+
+struct SpirvId
+{
+    spv::Op op = spv::OpNop;
+    std::vector<uint32_t> operands; // Without the result id
+    SpirvDecorations decorations;
+    std::vector<SpirvDecorations> memberDecorations;
+};
+
+class SpirvModule
+{
+public:
+    explicit SpirvModule(const std::vector<uint32_t> &spirv)
+    {
+        KL_PANIC_IF(spirv.size() < 5 || spirv[0] != spv::MagicNumber, "Invalid SPIR-V module");
+
+        for (size_t i = 5; i < spirv.size();)
+        {
+            const auto wordCount = spirv[i] >> 16;
+            const auto op = static_cast<spv::Op>(spirv[i] & 0xffff);
+            KL_PANIC_IF(!wordCount || i + wordCount > spirv.size(), "Malformed SPIR-V instruction");
+            parse(op, &spirv[i + 1], wordCount - 1);
+            i += wordCount;
+        }
+    }
+
+    auto getStage() const -> VkShaderStageFlags { return stage; }
+    auto getLocalSize() const -> const std::array<uint32_t, 3>& { return localSize; }
+    auto getIds() const -> const std::unordered_map<uint32_t, SpirvId>& { return ids; }
+
+    auto get(uint32_t id) const -> const SpirvId&
+    {
+        const auto it = ids.find(id);
+        KL_PANIC_IF(it == ids.end(), "Unknown SPIR-V id");
+        return it->second;
+    }
+
+    // Size of the type as laid out in a buffer block
+    auto getSize(uint32_t typeId, uint32_t matrixStride = 0) const -> uint32_t
+    {
+        const auto &type = get(typeId);
+        switch (type.op)
+        {
+            case spv::OpTypeInt:
+            case spv::OpTypeFloat:
+                return type.operands[0] / 8;
+            case spv::OpTypeVector:
+                return type.operands[1] * getSize(type.operands[0]);
+            case spv::OpTypeMatrix:
+                return type.operands[1] * (matrixStride ? matrixStride : getSize(type.operands[0]));
+            case spv::OpTypeArray:
+            {
+                const auto stride = type.decorations.arrayStride;
+                return getArrayLength(type) * (stride ? stride : getSize(type.operands[0], matrixStride));
+            }
+            case spv::OpTypeStruct:
+            {
+                uint32_t size = 0;
+                for (size_t i = 0; i < type.operands.size(); i++)
+                {
+                    const auto &member = type.memberDecorations[i];
+                    size = (std::max)(size, member.offset + getSize(type.operands[i], member.matrixStride));
+                }
+                return size;
+            }
+            default:
+                KL_PANIC("Unsupported SPIR-V type in buffer block");
+                return 0;
+        }
+    }
+
+    auto getArrayLength(const SpirvId &arrayType) const -> uint32_t
+    {
+        const auto &length = get(arrayType.operands[1]);
+        KL_PANIC_IF(length.op != spv::OpConstant, "Array length must be a constant");
+        return length.operands[1];
+    }
+
+private:
+    VkShaderStageFlags stage = 0;
+    std::array<uint32_t, 3> localSize{{1, 1, 1}};
+    std::unordered_map<uint32_t, SpirvId> ids;
+
+    void parse(spv::Op op, const uint32_t *words, uint32_t count)
+    {
+        switch (op)
+        {
+            case spv::OpEntryPoint:
+                stage |= toStage(static_cast<spv::ExecutionModel>(words[0]));
+                break;
+            case spv::OpExecutionMode:
+                if (words[1] == spv::ExecutionModeLocalSize && count >= 5)
+                    localSize = {{words[2], words[3], words[4]}};
+                break;
+            case spv::OpDecorate:
+                decorate(ids[words[0]].decorations, static_cast<spv::Decoration>(words[1]), count > 2 ? words[2] : 0);
+                break;
+            case spv::OpMemberDecorate:
+            {
+                auto &members = ids[words[0]].memberDecorations;
+                if (members.size() <= words[1])
+                    members.resize(words[1] + 1);
+                decorate(members[words[1]], static_cast<spv::Decoration>(words[2]), count > 3 ? words[3] : 0);
+                break;
+            }
+            case spv::OpTypeInt:
+            case spv::OpTypeFloat:
+            case spv::OpTypeVector:
+            case spv::OpTypeMatrix:
+            case spv::OpTypeImage:
+            case spv::OpTypeSampler:
+            case spv::OpTypeSampledImage:
+            case spv::OpTypeArray:
+            case spv::OpTypeRuntimeArray:
+            case spv::OpTypeStruct:
+            case spv::OpTypePointer:
+                define(words[0], op, words + 1, count - 1);
+                break;
+            case spv::OpConstant:
+            case spv::OpVariable:
+                // Result type goes first, keep it as the first operand
+                define(words[1], op, words, 1);
+                if (count > 2)
+                    ids[words[1]].operands.insert(ids[words[1]].operands.end(), words + 2, words + count);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void define(uint32_t id, spv::Op op, const uint32_t *operands, uint32_t count)
+    {
+        auto &entry = ids[id];
+        entry.op = op;
+        entry.operands.assign(operands, operands + count);
+        if (op == spv::OpTypeStruct && entry.memberDecorations.size() < count)
+            entry.memberDecorations.resize(count);
+    }
+
+    static void decorate(SpirvDecorations &decorations, spv::Decoration decoration, uint32_t value)
+    {
+        switch (decoration)
+        {
+            case spv::DecorationDescriptorSet: decorations.set = value; break;
+            case spv::DecorationBinding: decorations.binding = value; decorations.hasBinding = true; break;
+            case spv::DecorationLocation: decorations.location = value; decorations.hasLocation = true; break;
+            case spv::DecorationOffset: decorations.offset = value; break;
+            case spv::DecorationArrayStride: decorations.arrayStride = value; break;
+            case spv::DecorationMatrixStride: decorations.matrixStride = value; break;
+            case spv::DecorationBlock: decorations.block = true; break;
+            case spv::DecorationBufferBlock: decorations.bufferBlock = true; break;
+            case spv::DecorationBuiltIn: decorations.builtIn = true; break;
+            default: break;
+        }
+    }
+
+    static auto toStage(spv::ExecutionModel model) -> VkShaderStageFlags
+    {
+        switch (model)
+        {
+            case spv::ExecutionModelVertex: return VK_SHADER_STAGE_VERTEX_BIT;
+            case spv::ExecutionModelTessellationControl: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            case spv::ExecutionModelTessellationEvaluation: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            case spv::ExecutionModelGeometry: return VK_SHADER_STAGE_GEOMETRY_BIT;
+            case spv::ExecutionModelFragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case spv::ExecutionModelGLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+            default:
+                KL_PANIC("Unsupported shader execution model");
+                return 0;
+        }
+    }
+};
+
+static auto toDescriptorType(const SpirvId &type) -> VkDescriptorType
+{
+    switch (type.op)
+    {
+        case spv::OpTypeSampler:
+            return VK_DESCRIPTOR_TYPE_SAMPLER;
+        case spv::OpTypeSampledImage:
+            return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        case spv::OpTypeImage:
+        {
+            const auto dim = static_cast<spv::Dim>(type.operands[1]);
+            const auto sampled = type.operands[5];
+            if (dim == spv::DimSubpassData)
+                return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            if (dim == spv::DimBuffer)
+                return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+        case spv::OpTypeStruct:
+            if (type.decorations.bufferBlock)
+                return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            KL_PANIC_IF(!type.decorations.block, "Unsupported buffer block");
+            return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        default:
+            KL_PANIC("Unsupported descriptor type");
+            return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+    }
+}
+
+static auto toFormat(const SpirvModule &module, const SpirvId &type) -> VkFormat
+{
+    static const VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat intFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static const VkFormat uintFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+    const auto &scalar = type.op == spv::OpTypeVector ? module.get(type.operands[0]) : type;
+    const auto components = type.op == spv::OpTypeVector ? type.operands[1] : 1;
+    KL_PANIC_IF(scalar.operands[0] != 32 || components > 4, "Unsupported vertex input type");
+
+    if (scalar.op == spv::OpTypeFloat)
+        return floatFormats[components - 1];
+    return scalar.operands[1] ? intFormats[components - 1] : uintFormats[components - 1];
+}
+
+vk::ShaderReflection::ShaderReflection(const std::vector<uint32_t> &spirv)
+{
+    const SpirvModule module(spirv);
+    stages = module.getStage();
+    localSize = module.getLocalSize();
+
+    for (const auto &pair: module.getIds())
+    {
+        const auto &var = pair.second;
+        if (var.op != spv::OpVariable)
+            continue;
+
+        const auto &pointer = module.get(var.operands[0]);
+        const auto storageClass = static_cast<spv::StorageClass>(var.operands[1]);
+        const SpirvId *type = &module.get(pointer.operands[1]);
+
+        switch (storageClass)
+        {
+            case spv::StorageClassUniformConstant:
+            case spv::StorageClassUniform:
+            {
+                KL_PANIC_IF(!var.decorations.hasBinding, "Resource without binding");
+
+                uint32_t count = 1;
+                if (type->op == spv::OpTypeArray)
+                {
+                    count = module.getArrayLength(*type);
+                    type = &module.get(type->operands[0]);
+                }
+                else if (type->op == spv::OpTypeRuntimeArray)
+                {
+                    count = 0;
+                    type = &module.get(type->operands[0]);
+                }
+
+                bindings.push_back({var.decorations.set, var.decorations.binding,
+                    toDescriptorType(*type), count, stages});
+                break;
+            }
+
+            case spv::StorageClassPushConstant:
+            {
+                uint32_t offset = UINT32_MAX;
+                for (const auto &member: type->memberDecorations)
+                    offset = (std::min)(offset, member.offset);
+                pushConstants.stages = stages;
+                pushConstants.offset = offset;
+                pushConstants.size = module.getSize(pointer.operands[1]) - offset;
+                break;
+            }
+
+            case spv::StorageClassInput:
+            {
+                // Built-ins and inputs of later stages are provided by the pipeline itself
+                if (stages != VK_SHADER_STAGE_VERTEX_BIT || var.decorations.builtIn || !var.decorations.hasLocation)
+                    break;
+                vertexInputs.push_back({var.decorations.location, toFormat(module, *type), module.getSize(pointer.operands[1])});
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    std::sort(bindings.begin(), bindings.end(), [](const ReflectedBinding &a, const ReflectedBinding &b)
+    {
+        return std::tie(a.set, a.binding) < std::tie(b.set, b.binding);
+    });
+    std::sort(vertexInputs.begin(), vertexInputs.end(), [](const ReflectedVertexInput &a, const ReflectedVertexInput &b)
+    {
+        return a.location < b.location;
+    });
+}
+
+auto vk::ShaderReflection::merge(const ShaderReflection &other) -> ShaderReflection&
+{
+    stages |= other.stages;
+
+    for (const auto &binding: other.bindings)
+    {
+        const auto existing = std::find_if(bindings.begin(), bindings.end(), [&](const ReflectedBinding &b)
+        {
+            return b.set == binding.set && b.binding == binding.binding;
+        });
+
+        if (existing == bindings.end())
+            bindings.push_back(binding);
+        else
+        {
+            KL_PANIC_IF(existing->type != binding.type || existing->count != binding.count, "Stages disagree on binding");
+            existing->stages |= binding.stages;
+        }
+    }
+
+    std::sort(bindings.begin(), bindings.end(), [](const ReflectedBinding &a, const ReflectedBinding &b)
+    {
+        return std::tie(a.set, a.binding) < std::tie(b.set, b.binding);
+    });
+
+    // A stage may be listed in only one push constant range, so all stages share a single range covering every block
+    if (other.pushConstants.size)
+    {
+        if (!pushConstants.size)
+            pushConstants = other.pushConstants;
+        else
+        {
+            const auto end = (std::max)(pushConstants.offset + pushConstants.size, other.pushConstants.offset + other.pushConstants.size);
+            pushConstants.stages |= other.pushConstants.stages;
+            pushConstants.offset = (std::min)(pushConstants.offset, other.pushConstants.offset);
+            pushConstants.size = end - pushConstants.offset;
+        }
+    }
+
+    if (vertexInputs.empty())
+        vertexInputs = other.vertexInputs;
+    if (other.stages & VK_SHADER_STAGE_COMPUTE_BIT)
+        localSize = other.localSize;
+
+    return *this;
+}
+
+auto vk::ShaderReflection::getSetCount() const -> uint32_t
+{
+    return bindings.empty() ? 0 : bindings.back().set + 1;
+}
+
+auto vk::ShaderReflection::withDynamicBuffers(uint32_t set) -> ShaderReflection&
+{
+    for (auto &b: bindings)
+    {
+        if (b.set != set)
+            continue;
+        if (b.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+            b.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        else if (b.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+            b.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    }
+    return *this;
+}
+
+auto vk::ShaderReflection::getSetLayoutBuilder(VkDevice device, uint32_t set, VkShaderStageFlags bindingStages) const -> DescriptorSetLayoutBuilder
+{
+    if (!bindingStages)
+        bindingStages = stages & VK_SHADER_STAGE_COMPUTE_BIT ? VK_SHADER_STAGE_COMPUTE_BIT : VK_SHADER_STAGE_ALL_GRAPHICS;
+
+    DescriptorSetLayoutBuilder builder(device);
+    for (const auto &binding: bindings)
+    {
+        if (binding.set == set)
+            builder.withBinding(binding.binding, binding.type, binding.count, bindingStages);
+    }
+    return builder;
+}
@@ -0,0 +1,71 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include <vector>
+#include <array>
+
+namespace vk
+{
+    class DescriptorSetLayoutBuilder;
+
+    struct ReflectedBinding
+    {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType type;
+        uint32_t count; // 0 for runtime-sized arrays
+        VkShaderStageFlags stages;
+    };
+
+    struct ReflectedVertexInput
+    {
+        uint32_t location;
+        VkFormat format;
+        uint32_t size;
+    };
+
+    struct ReflectedPushConstants
+    {
+        VkShaderStageFlags stages = 0;
+        uint32_t offset = 0;
+        uint32_t size = 0;
+    };
+
+    // Resource interface of SPIR-V modules: descriptor bindings, push constant block and vertex inputs.
+    // Reflections of all stages of a pipeline are merged to describe the whole pipeline layout.
+    class ShaderReflection
+    {
+    public:
+        ShaderReflection() {}
+        explicit ShaderReflection(const std::vector<uint32_t> &spirv);
+
+        auto merge(const ShaderReflection &other) -> ShaderReflection&;
+
+        // SPIR-V doesn't tell plain buffers from dynamic ones, this turns all uniform and storage buffers of the set into dynamic ones
+        auto withDynamicBuffers(uint32_t set) -> ShaderReflection&;
+
+        auto getStages() const -> VkShaderStageFlags { return stages; }
+        auto getBindings() const -> const std::vector<ReflectedBinding>& { return bindings; } // Sorted by set and binding
+        auto getSetCount() const -> uint32_t;
+        auto getPushConstants() const -> const ReflectedPushConstants& { return pushConstants; }
+        auto getVertexInputs() const -> const std::vector<ReflectedVertexInput>& { return vertexInputs; } // Sorted by location
+        auto getLocalSize() const -> const std::array<uint32_t, 3>& { return localSize; } // Compute workgroup size
+
+        // Stage flags of the bindings are replaced with the given ones. By default it's all graphics stages (or compute
+        // for compute shaders), making set layouts independent of which stages happen to use them. This way pipelines
+        // share layouts and the sets stay bound across pipeline switches.
+        auto getSetLayoutBuilder(VkDevice device, uint32_t set, VkShaderStageFlags bindingStages = 0) const -> DescriptorSetLayoutBuilder;
+
+    private:
+        VkShaderStageFlags stages = 0;
+        std::vector<ReflectedBinding> bindings;
+        std::vector<ReflectedVertexInput> vertexInputs;
+        ReflectedPushConstants pushConstants;
+        std::array<uint32_t, 3> localSize{{1, 1, 1}};
+    };
+}
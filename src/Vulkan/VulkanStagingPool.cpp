@@ -0,0 +1,153 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanStagingPool.h"
+#include <algorithm>
+
+static const VkDeviceSize minLargeSizeClass = 1024 * 1024;
+
+static auto alignUp(VkDeviceSize value, VkDeviceSize alignment) -> VkDeviceSize
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static auto getLeastCommonMultiple(VkDeviceSize a, VkDeviceSize b) -> VkDeviceSize
+{
+    auto x = a, y = b;
+    while (y)
+    {
+        const auto r = x % y;
+        x = y;
+        y = r;
+    }
+    return a / x * b;
+}
+
+vk::StagingPool::StagingPool(VkDevice device, MemoryAllocator &allocator, VkDeviceSize ringSize,
+    VkDeviceSize copyOffsetAlignment):
+    device(device),
+    allocator(&allocator),
+    ringSize(ringSize),
+    copyOffsetAlignment((std::max)(copyOffsetAlignment, VkDeviceSize(1)))
+{
+    ring = createBuffer(ringSize);
+}
+
+auto vk::StagingPool::allocate(VkDeviceSize size, VkDeviceSize texelSize, uint64_t batchId) -> StagingRegion
+{
+    // Uploads taking a big share of the ring would keep stalling on it
+    if (size > ringSize / 4)
+        return allocateLarge(size, batchId);
+
+    // Image copies need offsets at multiples of 4 and of the texel size, the device may prefer a coarser alignment
+    const auto alignment = getLeastCommonMultiple(getLeastCommonMultiple(4, texelSize), copyOffsetAlignment);
+    auto offset = alignUp(head, alignment);
+    if (offset + size > ringSize)
+        offset = 0; // the rest of the ring is skipped
+
+    // Everything from the old head up to the end of the region, including padding or the skipped end of the ring
+    const auto taken = (offset >= head ? offset - head : ringSize - head) + size;
+    if (used + taken > ringSize)
+        return {};
+
+    head = offset + size;
+    used += taken;
+    highWater = (std::max)(highWater, used);
+
+    if (!spans.empty() && spans.back().batchId == batchId)
+        spans.back().size += taken;
+    else
+        spans.push_back({batchId, taken});
+
+    return {ring.buffer, offset, static_cast<uint8_t*>(ring.memory.getMappedData()) + offset};
+}
+
+void vk::StagingPool::release(uint64_t completeBatchId)
+{
+    while (!spans.empty() && spans.front().batchId <= completeBatchId)
+    {
+        used -= spans.front().size;
+        spans.pop_front();
+    }
+    if (spans.empty())
+        head = 0;
+
+    for (auto it = largeInUse.begin(); it != largeInUse.end();)
+    {
+        if (it->batchId <= completeBatchId)
+        {
+            largeUsed -= it->size;
+            largeFree.emplace(it->size, std::move(it->buffer));
+            it = largeInUse.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+auto vk::StagingPool::getStats() const -> StagingStats
+{
+    StagingStats stats;
+    stats.ringSize = ringSize;
+    stats.ringUsed = used;
+    stats.ringHighWater = highWater;
+    stats.largeBufferCount = largeBufferCount;
+    stats.largeBufferBytes = largeBufferBytes;
+    stats.largeHighWater = largeHighWater;
+    return stats;
+}
+
+auto vk::StagingPool::createBuffer(VkDeviceSize size) -> MappedBuffer
+{
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    MappedBuffer result;
+    result.buffer = Resource<VkBuffer>{device};
+    KL_VK_CHECK_RESULT(vkCreateBuffer(device, &bufferInfo, nullptr, result.buffer.cleanRef()));
+
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(device, result.buffer, &memReqs);
+
+    result.memory = allocator->allocate(memReqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, false);
+    KL_VK_CHECK_RESULT(vkBindBufferMemory(device, result.buffer, result.memory.getMemory(), result.memory.getOffset()));
+
+    return result;
+}
+
+auto vk::StagingPool::allocateLarge(VkDeviceSize size, uint64_t batchId) -> StagingRegion
+{
+    auto sizeClass = minLargeSizeClass;
+    while (sizeClass < size)
+        sizeClass <<= 1;
+
+    LargeBuffer large;
+    large.size = sizeClass;
+    large.batchId = batchId;
+
+    const auto it = largeFree.find(sizeClass);
+    if (it != largeFree.end())
+    {
+        large.buffer = std::move(it->second);
+        largeFree.erase(it);
+    }
+    else
+    {
+        large.buffer = createBuffer(sizeClass);
+        largeBufferCount++;
+        largeBufferBytes += sizeClass;
+    }
+
+    largeUsed += sizeClass;
+    largeHighWater = (std::max)(largeHighWater, largeUsed);
+
+    const StagingRegion region{large.buffer.buffer, 0, large.buffer.memory.getMappedData()};
+    largeInUse.push_back(std::move(large));
+
+    return region;
+}
@@ -0,0 +1,97 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanMemoryAllocator.h"
+#include <vector>
+#include <deque>
+#include <map>
+
+namespace vk
+{
+    struct StagingRegion
+    {
+        VkBuffer buffer = VK_NULL_HANDLE; // null if there's no room until earlier batches complete
+        VkDeviceSize offset = 0;
+        void *data = nullptr;
+    };
+
+    struct StagingStats
+    {
+        VkDeviceSize ringSize = 0;
+        VkDeviceSize ringUsed = 0;
+        VkDeviceSize ringHighWater = 0;
+        uint32_t largeBufferCount = 0; // created so far, in use or not
+        VkDeviceSize largeBufferBytes = 0;
+        VkDeviceSize largeHighWater = 0; // most bytes of large buffers in use at once
+    };
+
+    // Persistently mapped staging memory, handed out per upload batch and reused once the batch completes.
+    // Regular uploads come from a ring. Ones too large for it get buffers in power-of-two size classes, which are
+    // kept for later uploads of the same class. Apart from new size classes nothing is created after startup.
+    // Not thread-safe, UploadQueue guards it.
+    class StagingPool
+    {
+    public:
+        StagingPool() {}
+        // Regions are placed at multiples of the copy offset alignment, i.e. optimalBufferCopyOffsetAlignment
+        StagingPool(VkDevice device, MemoryAllocator &allocator, VkDeviceSize ringSize, VkDeviceSize copyOffsetAlignment);
+        StagingPool(const StagingPool &other) = delete;
+        StagingPool(StagingPool &&other) = default;
+        ~StagingPool() {}
+
+        auto operator=(const StagingPool &other) -> StagingPool& = delete;
+        auto operator=(StagingPool &&other) -> StagingPool& = default;
+
+        // Batch ids must not decrease between calls. Texel size is the size of a texel block for copies into images,
+        // 1 for buffer copies.
+        auto allocate(VkDeviceSize size, VkDeviceSize texelSize, uint64_t batchId) -> StagingRegion;
+        // Memory of all batches up to and including this one can be reused
+        void release(uint64_t completeBatchId);
+
+        auto getStats() const -> StagingStats;
+
+    private:
+        struct MappedBuffer
+        {
+            Allocation memory;
+            Resource<VkBuffer> buffer;
+        };
+
+        struct RingSpan
+        {
+            uint64_t batchId;
+            VkDeviceSize size; // including padding before the allocations
+        };
+
+        struct LargeBuffer
+        {
+            MappedBuffer buffer;
+            VkDeviceSize size;
+            uint64_t batchId;
+        };
+
+        VkDevice device = nullptr;
+        MemoryAllocator *allocator = nullptr;
+        MappedBuffer ring;
+        VkDeviceSize ringSize = 0;
+        VkDeviceSize copyOffsetAlignment = 1;
+        VkDeviceSize head = 0;
+        VkDeviceSize used = 0;
+        VkDeviceSize highWater = 0;
+        std::deque<RingSpan> spans; // oldest first
+        std::vector<LargeBuffer> largeInUse;
+        std::multimap<VkDeviceSize, MappedBuffer> largeFree; // by size class
+        uint32_t largeBufferCount = 0;
+        VkDeviceSize largeBufferBytes = 0;
+        VkDeviceSize largeUsed = 0;
+        VkDeviceSize largeHighWater = 0;
+
+        auto createBuffer(VkDeviceSize size) -> MappedBuffer;
+        auto allocateLarge(VkDeviceSize size, uint64_t batchId) -> StagingRegion;
+    };
+}
@@ -5,6 +5,7 @@
 
 #include "VulkanSwapchain.h"
 #include "VulkanDevice.h"
+#include <algorithm>
 
 static auto getSwapchainImages(VkDevice device, VkSwapchainKHR swapchain) -> std::vector<VkImage>
 {
@@ -18,7 +19,7 @@ static auto getSwapchainImages(VkDevice device, VkSwapchainKHR swapchain) -> std
     return images;
 }
 
-static auto getPresentMode(const vk::Device &device, bool vsync) -> VkPresentModeKHR
+static auto getPresentMode(const vk::Device &device, VkPresentModeKHR preferredMode) -> VkPresentModeKHR
 {
     uint32_t presentModeCount;
     KL_VK_CHECK_RESULT(vkGetPhysicalDeviceSurfacePresentModesKHR(device.getPhysicalDevice(), device.getSurface(), &presentModeCount, nullptr));
@@ -26,111 +27,238 @@ static auto getPresentMode(const vk::Device &device, bool vsync) -> VkPresentMod
     std::vector<VkPresentModeKHR> presentModes(presentModeCount);
     KL_VK_CHECK_RESULT(vkGetPhysicalDeviceSurfacePresentModesKHR(device.getPhysicalDevice(), device.getSurface(), &presentModeCount, presentModes.data()));
 
-    auto presentMode = VK_PRESENT_MODE_FIFO_KHR; // "vsync"
+    // Mailbox and immediate both don't block on vblank, relaxed FIFO is FIFO that may tear when a frame is late
+    std::vector<VkPresentModeKHR> candidates{preferredMode};
+    if (preferredMode == VK_PRESENT_MODE_MAILBOX_KHR)
+        candidates.push_back(VK_PRESENT_MODE_IMMEDIATE_KHR);
+    if (preferredMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
+        candidates.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
 
-    if (!vsync)
+    for (const auto candidate: candidates)
     {
-        for (const auto mode : presentModes)
-        {
-            if (mode == VK_PRESENT_MODE_IMMEDIATE_KHR)
-                presentMode = mode;
-            if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
-            {
-                presentMode = mode;
-                break;
-            }
-        }
+        if (std::find(presentModes.begin(), presentModes.end(), candidate) != presentModes.end())
+            return candidate;
     }
 
-    return presentMode;
+    return VK_PRESENT_MODE_FIFO_KHR; // "vsync", always supported
 }
 
-static auto createSwapchain(const vk::Device &device, uint32_t width, uint32_t height, bool vsync) -> vk::Resource<VkSwapchainKHR>
+static auto createSwapchain(const vk::Device &device, VkExtent2D extent, VkSurfaceTransformFlagBitsKHR transform,
+    uint32_t imageCount, VkPresentModeKHR presentMode, VkSwapchainKHR oldSwapchain) -> vk::Resource<VkSwapchainKHR>
 {
-    VkSurfaceCapabilitiesKHR capabilities;
-    KL_VK_CHECK_RESULT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device.getPhysicalDevice(), device.getSurface(), &capabilities));
-
-    if (capabilities.currentExtent.width != static_cast<uint32_t>(-1))
-    {
-        width = capabilities.currentExtent.width;
-        height = capabilities.currentExtent.height;
-    }
-
-    VkSurfaceTransformFlagsKHR transformFlags;
-    if (capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
-        transformFlags = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-    else
-        transformFlags = capabilities.currentTransform;
-
-    auto requestedImageCount = capabilities.minImageCount + 1;
-    if (capabilities.maxImageCount > 0 && requestedImageCount > capabilities.maxImageCount)
-        requestedImageCount = capabilities.maxImageCount;
-
-    auto presentMode = getPresentMode(device, vsync);
-
     VkSwapchainCreateInfoKHR swapchainInfo{};
     swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     swapchainInfo.pNext = nullptr;
     swapchainInfo.surface = device.getSurface();
-    swapchainInfo.minImageCount = requestedImageCount;
+    swapchainInfo.minImageCount = imageCount;
     swapchainInfo.imageFormat = device.getColorFormat();
     swapchainInfo.imageColorSpace = device.getColorSpace();
-    swapchainInfo.imageExtent = {width, height};
+    swapchainInfo.imageExtent = extent;
     swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    swapchainInfo.preTransform = static_cast<VkSurfaceTransformFlagBitsKHR>(transformFlags);
+    swapchainInfo.preTransform = transform;
     swapchainInfo.imageArrayLayers = 1;
     swapchainInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     swapchainInfo.queueFamilyIndexCount = 0;
     swapchainInfo.pQueueFamilyIndices = nullptr;
+
+    // Images are rendered on the main queue and presented from another family, concurrent sharing saves
+    // ownership transfers
+    const uint32_t queueFamilies[] = {device.getQueueIndex(), device.getPresentQueueIndex()};
+    if (queueFamilies[0] != queueFamilies[1])
+    {
+        swapchainInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        swapchainInfo.queueFamilyIndexCount = 2;
+        swapchainInfo.pQueueFamilyIndices = queueFamilies;
+    }
+
     swapchainInfo.presentMode = presentMode;
-    swapchainInfo.oldSwapchain = nullptr;
+    swapchainInfo.oldSwapchain = oldSwapchain;
     swapchainInfo.clipped = VK_TRUE;
     swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 
-    vk::Resource<VkSwapchainKHR> swapchain{device, vkDestroySwapchainKHR};
+    vk::Resource<VkSwapchainKHR> swapchain{device};
     KL_VK_CHECK_RESULT(vkCreateSwapchainKHR(device, &swapchainInfo, nullptr, swapchain.cleanRef()));
 
     return swapchain;
 }
 
-vk::Swapchain::Swapchain(const Device &device, uint32_t width, uint32_t height, bool vsync):
-    device(device)
+static auto getMs(std::chrono::high_resolution_clock::duration duration) -> double
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+auto vk::SwapchainConfig::withPresentMode(VkPresentModeKHR mode) -> SwapchainConfig&
 {
-    const auto colorFormat = device.getColorFormat();
-    const auto depthFormat = device.getDepthFormat();
+    presentMode = mode;
+    return *this;
+}
+
+auto vk::SwapchainConfig::withImageCount(uint32_t count) -> SwapchainConfig&
+{
+    imageCount = count;
+    return *this;
+}
 
-    swapchain = createSwapchain(device, width, height, vsync);
+auto vk::SwapchainConfig::withFrameCount(uint32_t count) -> SwapchainConfig&
+{
+    frameCount = count;
+    return *this;
+}
 
+vk::Swapchain::Swapchain(const Device &device, uint32_t width, uint32_t height, const SwapchainConfig &config):
+    owner(&device),
+    device(device),
+    presentQueue(device.getPresentQueue()),
+    config(config)
+{
     renderPass = RenderPass(device, RenderPassConfig()
-        .withColorAttachment(colorFormat, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, true, {0, 0, 0, 1})
-        .withDepthAttachment(depthFormat, true, {1, 0}));
-    
-    depthStencil = Image(device, width, height, 1, 1, depthFormat,
+        .withColorAttachment(device.getColorFormat(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, true, {0, 0, 0, 1})
+        .withDepthAttachment(device.getDepthFormat(), true, {1, 0}));
+
+    stats.presentMode = getPresentMode(device, config.presentMode);
+
+    create({width, height});
+
+    frames.resize(config.frameCount);
+    for (auto &frame: frames)
+    {
+        frame.fence = createFence(device, true);
+        frame.presentCompleteSem = createSemaphore(device);
+        frame.renderCompleteSem = createSemaphore(device);
+    }
+}
+
+void vk::Swapchain::create(VkExtent2D extent)
+{
+    VkSurfaceCapabilitiesKHR capabilities;
+    KL_VK_CHECK_RESULT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(owner->getPhysicalDevice(), owner->getSurface(), &capabilities));
+
+    if (capabilities.currentExtent.width != static_cast<uint32_t>(-1))
+        extent = capabilities.currentExtent;
+
+    VkSurfaceTransformFlagsKHR transformFlags;
+    if (capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
+        transformFlags = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+    else
+        transformFlags = capabilities.currentTransform;
+
+    auto requestedImageCount = config.imageCount ? config.imageCount : capabilities.minImageCount + 1;
+    requestedImageCount = (std::max)(requestedImageCount, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0)
+        requestedImageCount = (std::min)(requestedImageCount, capabilities.maxImageCount);
+
+    swapchain = createSwapchain(*owner, extent, static_cast<VkSurfaceTransformFlagBitsKHR>(transformFlags),
+        requestedImageCount, stats.presentMode, swapchain);
+    width = extent.width;
+    height = extent.height;
+
+    depthStencil = Image(*owner, width, height, 1, 1, owner->getDepthFormat(),
         0,
         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
         VK_IMAGE_VIEW_TYPE_2D,
         VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT);
 
     auto images = getSwapchainImages(device, swapchain);
+    stats.imageCount = images.size();
     
+    steps.clear();
     steps.resize(images.size());
     for (uint32_t i = 0; i < images.size(); i++)
     {
-        auto view = createImageView(device, colorFormat, VK_IMAGE_VIEW_TYPE_2D, 1, 1, images[i], VK_IMAGE_ASPECT_COLOR_BIT);
+        auto view = createImageView(device, owner->getColorFormat(), VK_IMAGE_VIEW_TYPE_2D, 1, 1, images[i], VK_IMAGE_ASPECT_COLOR_BIT);
         steps[i].framebuffer = createFrameBuffer(device, view, depthStencil.getView(), renderPass, width, height);
         steps[i].image = images[i];
         steps[i].imageView = std::move(view);
-        steps[i].cmdBuffer = createCommandBuffer(device, device.getCommandPool());
+        steps[i].cmdBuffer = createCommandBuffer(device, owner->getCommandPool());
+    }
+}
+
+auto vk::Swapchain::recreate() -> bool
+{
+    VkSurfaceCapabilitiesKHR capabilities;
+    KL_VK_CHECK_RESULT(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(owner->getPhysicalDevice(), owner->getSurface(), &capabilities));
+    if (capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0)
+        return false;
+
+    // Frames in flight still use the images, framebuffers and command buffers
+    KL_VK_CHECK_RESULT(vkDeviceWaitIdle(device));
+    for (auto &frame: frames)
+        measureLatency(frame, false);
+
+    // The old swapchain is retired by creating the new one from it and destroyed once replaced
+    create({width, height});
+    if (issueCommands)
+        recordCommandBuffers(issueCommands);
+
+    // A failed present may have left its wait semaphore signaled
+    for (auto &frame: frames)
+    {
+        frame.presentCompleteSem = createSemaphore(device);
+        frame.renderCompleteSem = createSemaphore(device);
     }
 
-    presentCompleteSem = createSemaphore(device);
-    renderCompleteSem = createSemaphore(device);
+    outdated = false;
+    stats.recreateCount++;
+
+    return true;
+}
+
+void vk::Swapchain::measureLatency(Frame &frame, bool wait)
+{
+    if (frame.measured)
+        return;
+
+    if (wait)
+        KL_VK_CHECK_RESULT(vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+    else if (vkGetFenceStatus(device, frame.fence) != VK_SUCCESS)
+        return;
+
+    const auto latency = getMs(Clock::now() - frame.acquireTime);
+    stats.latencyCount++;
+    stats.latencyMs += latency;
+    stats.maxLatencyMs = (std::max)(stats.maxLatencyMs, latency);
+    frame.measured = true;
 }
 
 auto vk::Swapchain::acquireNext() -> VkSemaphore
 {
-    KL_VK_CHECK_RESULT(vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, presentCompleteSem, nullptr, &nextStep));
-    return presentCompleteSem;
+    const auto waitStartTime = Clock::now();
+
+    for (auto &frame: frames)
+        measureLatency(frame, false);
+
+    auto &frame = frames[frameIndex];
+    measureLatency(frame, true);
+    KL_VK_CHECK_RESULT(vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX));
+
+    if (outdated && !recreate())
+        return VK_NULL_HANDLE;
+
+    auto result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame.presentCompleteSem, nullptr, &nextStep);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        if (!recreate())
+            return VK_NULL_HANDLE;
+        result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame.presentCompleteSem, nullptr, &nextStep);
+    }
+    KL_PANIC_IF(result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR, "Failed to acquire swapchain image");
+
+    // Still usable, presenting it is fine
+    if (result == VK_SUBOPTIMAL_KHR)
+        outdated = true;
+
+    // Images can be acquired out of order, and the command buffer of the image may still be in use by another frame
+    auto &step = steps[nextStep];
+    if (step.fence && step.fence != frame.fence)
+        KL_VK_CHECK_RESULT(vkWaitForFences(device, 1, &step.fence, VK_TRUE, UINT64_MAX));
+    step.fence = frame.fence;
+
+    KL_VK_CHECK_RESULT(vkResetFences(device, 1, &frame.fence));
+
+    frame.acquireTime = Clock::now();
+    stats.acquireWaitMs += getMs(frame.acquireTime - waitStartTime);
+
+    return frame.presentCompleteSem;
 }
 
 void vk::Swapchain::recordCommandBuffers(std::function<void(VkFramebuffer, VkCommandBuffer)> issueCommands)
@@ -142,11 +270,22 @@ void vk::Swapchain::recordCommandBuffers(std::function<void(VkFramebuffer, VkCom
         issueCommands(steps[i].framebuffer, buf);
         KL_VK_CHECK_RESULT(vkEndCommandBuffer(buf));
     }
+
+    this->issueCommands = std::move(issueCommands);
 }
 
-void vk::Swapchain::presentNext(VkQueue queue, uint32_t waitSemaphoreCount, const VkSemaphore *waitSemaphores)
+void vk::Swapchain::presentNext(VkQueue queue, uint32_t waitSemaphoreCount, const VkSemaphore *waitSemaphores,
+    VkCommandBuffer before, VkCommandBuffer after)
 {
-    queueSubmit(queue, waitSemaphoreCount, waitSemaphores, 1, &renderCompleteSem, 1, &steps[nextStep].cmdBuffer);
+    auto &frame = frames[frameIndex];
+    std::vector<VkCommandBuffer> cmdBuffers;
+    if (before)
+        cmdBuffers.push_back(before);
+    cmdBuffers.push_back(steps[nextStep].cmdBuffer);
+    if (after)
+        cmdBuffers.push_back(after);
+    queueSubmit(queue, waitSemaphoreCount, waitSemaphores, 1, &frame.renderCompleteSem,
+        cmdBuffers.size(), cmdBuffers.data(), frame.fence);
 
     VkPresentInfoKHR presentInfo{};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -154,7 +293,17 @@ void vk::Swapchain::presentNext(VkQueue queue, uint32_t waitSemaphoreCount, cons
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &swapchain;
     presentInfo.pImageIndices = &nextStep;
-    presentInfo.pWaitSemaphores = &renderCompleteSem;
+    presentInfo.pWaitSemaphores = &frame.renderCompleteSem;
     presentInfo.waitSemaphoreCount = 1;
-    KL_VK_CHECK_RESULT(vkQueuePresentKHR(queue, &presentInfo));
+    const auto result = vkQueuePresentKHR(presentQueue, &presentInfo);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+        outdated = true;
+    else
+        KL_PANIC_IF(result != VK_SUCCESS, "Failed to present swapchain image");
+
+    stats.presentCount++;
+    stats.acquireToPresentMs += getMs(Clock::now() - frame.acquireTime);
+    frame.measured = false;
+
+    frameIndex = (frameIndex + 1) % frames.size();
 }
@@ -10,16 +10,54 @@
 #include "VulkanRenderPass.h"
 #include <vector>
 #include <functional>
+#include <chrono>
 
 namespace vk
 {
     class Device;
 
+    class SwapchainConfig
+    {
+    public:
+        // Unsupported modes fall back to the closest supported one: MAILBOX and IMMEDIATE to each other, FIFO_RELAXED
+        // to FIFO, FIFO is always there
+        auto withPresentMode(VkPresentModeKHR mode) -> SwapchainConfig&;
+        // 0 for one more than the surface minimum, clamped to the surface limits
+        auto withImageCount(uint32_t count) -> SwapchainConfig&;
+        auto withFrameCount(uint32_t count) -> SwapchainConfig&;
+
+    private:
+        friend class Swapchain;
+
+        VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        uint32_t imageCount = 0;
+        uint32_t frameCount = 2;
+    };
+
+    struct SwapchainStats
+    {
+        VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR; // negotiated
+        uint32_t imageCount = 0;
+        uint32_t recreateCount = 0;
+        uint64_t presentCount = 0;
+        double acquireWaitMs = 0; // total time blocked in acquireNext()
+        double acquireToPresentMs = 0; // total time from acquiring an image until presenting it
+        // From acquiring an image until the frame is seen complete. Completion is polled once per acquire and present,
+        // so it's an upper bound off by up to a frame's CPU time.
+        uint64_t latencyCount = 0;
+        double latencyMs = 0; // total
+        double maxLatencyMs = 0;
+    };
+
+    // Up to frameCount frames can be in flight. Each frame slot has its own fence and semaphores, acquiring waits
+    // only for the frame that last used the slot (and the one that last rendered into the acquired image).
+    // Out-of-date and suboptimal swapchains are recreated for the current surface size on the next acquire, after
+    // waiting for the device to go idle, and the command buffers are re-recorded.
     class Swapchain
     {
     public:
         Swapchain() {}
-        Swapchain(const Device &device, uint32_t width, uint32_t height, bool vsync);
+        Swapchain(const Device &device, uint32_t width, uint32_t height, const SwapchainConfig &config);
         Swapchain(const Swapchain &other) = delete;
         Swapchain(Swapchain &&other) = default;
         ~Swapchain() {}
@@ -31,28 +69,63 @@ namespace vk
         operator VkSwapchainKHR() const { return swapchain; }
 
         auto getRenderPass() -> RenderPass& { return renderPass; }
-        auto getPresentCompleteSemaphore() const -> VkSemaphore { return presentCompleteSem; }
+        auto getFrameCount() const -> uint32_t { return frames.size(); }
+        auto getFrameIndex() const -> uint32_t { return frameIndex; } // slot of the current frame, for per-frame resources
+        auto getWidth() const -> uint32_t { return width; }
+        auto getHeight() const -> uint32_t { return height; }
+        auto getStats() const -> SwapchainStats { return stats; }
 
+        // Called again for the new images whenever the swapchain is recreated
         void recordCommandBuffers(std::function<void(VkFramebuffer, VkCommandBuffer)> issueCommands);
+        // Waits until the current frame slot can be reused. The returned semaphore is signaled once the image is acquired.
+        // Null if the surface has zero size (e.g. the window is minimized), the frame should be skipped then.
         auto acquireNext() -> VkSemaphore;
-        void presentNext(VkQueue queue, uint32_t waitSemaphoreCount, const VkSemaphore *waitSemaphores);
+        // Submits the commands of the acquired image to the queue, signaling the frame fence, presents on the
+        // device's present queue and moves on to the next frame slot. The optional command buffers are submitted
+        // right before and after the image's ones, e.g. to time them.
+        void presentNext(VkQueue queue, uint32_t waitSemaphoreCount, const VkSemaphore *waitSemaphores,
+            VkCommandBuffer before = VK_NULL_HANDLE, VkCommandBuffer after = VK_NULL_HANDLE);
 
     private:
+        using Clock = std::chrono::high_resolution_clock;
+
         struct Step
         {
             VkImage image;
             Resource<VkImageView> imageView;
             Resource<VkFramebuffer> framebuffer;
             Resource<VkCommandBuffer> cmdBuffer;
+            VkFence fence = VK_NULL_HANDLE; // of the frame that last rendered into the image
         };
 
+        struct Frame
+        {
+            Resource<VkFence> fence;
+            Resource<VkSemaphore> presentCompleteSem;
+            Resource<VkSemaphore> renderCompleteSem;
+            Clock::time_point acquireTime;
+            bool measured = true; // latency of the last frame in the slot recorded
+        };
+
+        const Device *owner = nullptr; // for recreation
         VkDevice device = nullptr;
+        VkQueue presentQueue = nullptr;
+        SwapchainConfig config;
         Resource<VkSwapchainKHR> swapchain;
+        uint32_t width = 0;
+        uint32_t height = 0;
         Image depthStencil;
         std::vector<Step> steps;
-        Resource<VkSemaphore> presentCompleteSem;
-        Resource<VkSemaphore> renderCompleteSem;
+        std::vector<Frame> frames;
         RenderPass renderPass;
+        std::function<void(VkFramebuffer, VkCommandBuffer)> issueCommands;
         uint32_t nextStep = 0;
+        uint32_t frameIndex = 0;
+        bool outdated = false;
+        SwapchainStats stats;
+
+        void create(VkExtent2D extent);
+        auto recreate() -> bool;
+        void measureLatency(Frame &frame, bool wait);
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,74 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanTextureTable.h"
+#include "VulkanDevice.h"
+#include "VulkanDescriptorSetLayoutBuilder.h"
+#include <algorithm>
+
+bool vk::TextureTable::isSupported(const Device &device)
+{
+    return device.getExtensions().descriptorIndexing;
+}
+
+vk::TextureTable::TextureTable(const Device &device, uint32_t capacity):
+    device(device),
+    mutex(std::make_unique<std::mutex>())
+{
+    KL_PANIC_IF(!isSupported(device), "Descriptor indexing is not supported");
+
+    // Update-after-bind limits are at least as large as these
+    const auto &limits = device.getPhysicalProperties().limits;
+    this->capacity = (std::min)({capacity, limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages,
+        limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages});
+
+    layout = DescriptorSetLayoutBuilder(device)
+        .withBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->capacity, VK_SHADER_STAGE_ALL_GRAPHICS)
+        .withBindingFlags(0, VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT)
+        .withFlags(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT)
+        .build();
+
+    pool = DescriptorPool(device, 1, DescriptorPoolConfig()
+        .forDescriptors(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->capacity)
+        .withFlags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT));
+    set = pool.allocateSet(layout);
+}
+
+auto vk::TextureTable::add(VkImageView view, VkSampler sampler, VkImageLayout layout) -> uint32_t
+{
+    std::lock_guard<std::mutex> lock(*mutex);
+
+    uint32_t index;
+    if (!freeSlots.empty())
+    {
+        index = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        KL_PANIC_IF(nextSlot >= capacity, "Texture table is full");
+        index = nextSlot++;
+    }
+
+    const VkDescriptorImageInfo imageInfo{sampler, view, layout};
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.dstArrayElement = index;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount = 1;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+    return index;
+}
+
+void vk::TextureTable::remove(uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(*mutex);
+    freeSlots.push_back(index);
+}
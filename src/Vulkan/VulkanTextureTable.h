@@ -0,0 +1,55 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanDescriptorPool.h"
+#include <vector>
+#include <mutex>
+
+namespace vk
+{
+    class Device;
+
+    // One large array of combined image samplers in a single set (binding 0), indexed from shaders by texture index
+    // instead of binding a set per texture. Built on VK_EXT_descriptor_indexing: the array is partially bound, so
+    // unused slots can stay empty, and updated after bind, so textures can be added while the set is in use.
+    // Shaders declare it as a runtime-sized array. Thread-safe.
+    class TextureTable
+    {
+    public:
+        static bool isSupported(const Device &device);
+
+        TextureTable() {}
+        // Capacity is clamped to what the device allows per stage and per set
+        TextureTable(const Device &device, uint32_t capacity);
+        TextureTable(const TextureTable &other) = delete;
+        TextureTable(TextureTable &&other) = default;
+        ~TextureTable() {}
+
+        auto operator=(const TextureTable &other) -> TextureTable& = delete;
+        auto operator=(TextureTable &&other) -> TextureTable& = default;
+
+        // Returns the index of the texture in the array
+        auto add(VkImageView view, VkSampler sampler, VkImageLayout layout) -> uint32_t;
+        // The slot is reused by later calls to add(), draws using it must be complete by then
+        void remove(uint32_t index);
+
+        auto getLayout() const -> VkDescriptorSetLayout { return layout; }
+        auto getSet() const -> VkDescriptorSet { return set; }
+        auto getCapacity() const -> uint32_t { return capacity; }
+
+    private:
+        VkDevice device = nullptr;
+        uint32_t capacity = 0;
+        Resource<VkDescriptorSetLayout> layout;
+        DescriptorPool pool;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        std::vector<uint32_t> freeSlots;
+        uint32_t nextSlot = 0;
+        uptr<std::mutex> mutex;
+    };
+}
@@ -0,0 +1,258 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#include "VulkanUploadQueue.h"
+#include <cstring>
+
+// Batches are submitted early once they hold this much data, so that copying overlaps further loading
+// while the previous batch is still being copied from the other half of the staging ring
+static const VkDeviceSize stagingRingSize = 64 * 1024 * 1024;
+static const VkDeviceSize maxBatchStagingSize = stagingRingSize / 2;
+
+vk::UploadQueue::UploadQueue(VkDevice device, MemoryAllocator &allocator, VkQueue queue, uint32_t queueIndex,
+    VkQueue transferQueue, uint32_t transferQueueIndex, VkDeviceSize copyOffsetAlignment):
+    device(device),
+    queue(queue),
+    transferQueue(transferQueue),
+    queueIndex(queueIndex),
+    transferQueueIndex(transferQueueIndex)
+{
+    const auto flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    transferCmdPool = createCommandPool(device, transferQueueIndex, flags);
+    if (hasSeparateFamily())
+        acquireCmdPool = createCommandPool(device, queueIndex, flags);
+    stagingPool = StagingPool(device, allocator, stagingRingSize, copyOffsetAlignment);
+}
+
+vk::UploadQueue::~UploadQueue()
+{
+    for (const auto &batch: submitted)
+        KL_VK_CHECK_RESULT(vkWaitForFences(device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+}
+
+void vk::UploadQueue::uploadBuffer(VkBuffer buffer, const void *data, VkDeviceSize size,
+    VkAccessFlags dstAccess, VkPipelineStageFlags dstStages)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto staging = allocateStaging(data, size, 1);
+    auto &batch = getRecordingBatch();
+    batch.stagingSize += size;
+
+    VkBufferCopy region{};
+    region.srcOffset = staging.offset;
+    region.size = size;
+    vkCmdCopyBuffer(batch.transferCmdBuf, staging.buffer, buffer, 1, &region);
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = hasSeparateFamily() ? transferQueueIndex : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = hasSeparateFamily() ? queueIndex : VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    batch.bufferBarriers.push_back(barrier);
+    batch.dstStages |= dstStages;
+
+    flushIfLarge();
+}
+
+void vk::UploadQueue::uploadImage(VkImage image, VkImageAspectFlags aspectMask, VkDeviceSize texelSize,
+    const void *data, VkDeviceSize size, const std::vector<VkBufferImageCopy> &regions, VkImageLayout layout,
+    VkAccessFlags dstAccess, VkPipelineStageFlags dstStages)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto staging = allocateStaging(data, size, texelSize);
+    auto &batch = getRecordingBatch();
+    batch.stagingSize += size;
+
+    auto stagingRegions = regions;
+    for (auto &region: stagingRegions)
+        region.bufferOffset += staging.offset;
+
+    // Whole mip levels are copied, so the image transfer granularity of transfer-only families doesn't matter
+    imageBarrier(batch.transferCmdBuf, image, aspectMask,
+        VK_IMAGE_LAYOUT_UNDEFINED, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    vkCmdCopyBufferToImage(batch.transferCmdBuf, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        stagingRegions.size(), stagingRegions.data());
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = layout;
+    barrier.srcQueueFamilyIndex = hasSeparateFamily() ? transferQueueIndex : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = hasSeparateFamily() ? queueIndex : VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {aspectMask, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+    batch.imageBarriers.push_back(barrier);
+    batch.dstStages |= dstStages;
+
+    flushIfLarge();
+}
+
+auto vk::UploadQueue::flush() -> uint64_t
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (recording)
+        submit();
+    recycleComplete();
+    return lastSubmittedId;
+}
+
+auto vk::UploadQueue::isComplete(uint64_t batchId) -> bool
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    recycleComplete();
+    return batchId <= lastSubmittedId && (submitted.empty() || submitted.front()->id > batchId);
+}
+
+void vk::UploadQueue::wait(uint64_t batchId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (recording && recording->id <= batchId)
+        submit();
+
+    for (const auto &batch: submitted)
+    {
+        if (batch->id > batchId)
+            break;
+        KL_VK_CHECK_RESULT(vkWaitForFences(device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+    }
+
+    recycleComplete();
+}
+
+void vk::UploadQueue::waitIdle()
+{
+    wait(flush());
+}
+
+auto vk::UploadQueue::getStagingStats() -> StagingStats
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stagingPool.getStats();
+}
+
+auto vk::UploadQueue::getRecordingBatch() -> Batch&
+{
+    if (recording)
+        return *recording;
+
+    if (!spare.empty())
+    {
+        recording = std::move(spare.back());
+        spare.pop_back();
+    }
+    else
+    {
+        recording = std::make_unique<Batch>();
+        recording->transferCmdBuf = createCommandBuffer(device, transferCmdPool);
+        recording->fence = createFence(device, false);
+        if (hasSeparateFamily())
+        {
+            recording->acquireCmdBuf = createCommandBuffer(device, acquireCmdPool);
+            recording->semaphore = createSemaphore(device);
+        }
+    }
+
+    recording->id = nextBatchId++;
+    beginCommandBuffer(recording->transferCmdBuf, true);
+
+    return *recording;
+}
+
+auto vk::UploadQueue::allocateStaging(const void *data, VkDeviceSize size, VkDeviceSize texelSize) -> StagingRegion
+{
+    while (true)
+    {
+        // Allocations are tagged with the batch they'll be recorded into
+        const auto batchId = recording ? recording->id : nextBatchId;
+        const auto region = stagingPool.allocate(size, texelSize, batchId);
+        if (region.buffer)
+        {
+            memcpy(region.data, data, size);
+            return region;
+        }
+
+        // Out of staging memory, wait for the oldest batch. If it's the one being recorded, it's submitted first.
+        if (submitted.empty())
+        {
+            KL_PANIC_IF(!recording, "Staging ring is empty but can't fit the upload");
+            submit();
+        }
+        KL_VK_CHECK_RESULT(vkWaitForFences(device, 1, &submitted.front()->fence, VK_TRUE, UINT64_MAX));
+        recycleComplete();
+    }
+}
+
+void vk::UploadQueue::submit()
+{
+    auto &batch = *recording;
+
+    if (hasSeparateFamily())
+    {
+        // Release on the transfer queue, the semaphore orders it before the acquire on the main queue. Acquire
+        // barriers wait for the same stages that the semaphore is waited on.
+        vkCmdPipelineBarrier(batch.transferCmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, batch.bufferBarriers.size(), batch.bufferBarriers.data(), batch.imageBarriers.size(), batch.imageBarriers.data());
+        KL_VK_CHECK_RESULT(vkEndCommandBuffer(batch.transferCmdBuf));
+        queueSubmit(transferQueue, 0, nullptr, 1, &batch.semaphore, 1, &batch.transferCmdBuf);
+
+        for (auto &barrier: batch.bufferBarriers)
+            barrier.srcAccessMask = 0;
+        for (auto &barrier: batch.imageBarriers)
+            barrier.srcAccessMask = 0;
+
+        beginCommandBuffer(batch.acquireCmdBuf, true);
+        vkCmdPipelineBarrier(batch.acquireCmdBuf, batch.dstStages, batch.dstStages, 0,
+            0, nullptr, batch.bufferBarriers.size(), batch.bufferBarriers.data(), batch.imageBarriers.size(), batch.imageBarriers.data());
+        KL_VK_CHECK_RESULT(vkEndCommandBuffer(batch.acquireCmdBuf));
+        queueSubmit(queue, 1, &batch.semaphore, 0, nullptr, 1, &batch.acquireCmdBuf, batch.fence, batch.dstStages);
+    }
+    else
+    {
+        vkCmdPipelineBarrier(batch.transferCmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, batch.dstStages, 0,
+            0, nullptr, batch.bufferBarriers.size(), batch.bufferBarriers.data(), batch.imageBarriers.size(), batch.imageBarriers.data());
+        KL_VK_CHECK_RESULT(vkEndCommandBuffer(batch.transferCmdBuf));
+        queueSubmit(queue, 0, nullptr, 0, nullptr, 1, &batch.transferCmdBuf, batch.fence);
+    }
+
+    lastSubmittedId = batch.id;
+    submitted.push_back(std::move(recording));
+}
+
+void vk::UploadQueue::recycleComplete()
+{
+    // Fences are all signaled from the main queue, so batches complete in submission order
+    auto it = submitted.begin();
+    for (; it != submitted.end() && vkGetFenceStatus(device, (*it)->fence) == VK_SUCCESS; ++it)
+    {
+        auto &batch = **it;
+        KL_VK_CHECK_RESULT(vkResetFences(device, 1, &batch.fence));
+        stagingPool.release(batch.id);
+        batch.bufferBarriers.clear();
+        batch.imageBarriers.clear();
+        batch.dstStages = 0;
+        batch.stagingSize = 0;
+        spare.push_back(std::move(*it));
+    }
+    submitted.erase(submitted.begin(), it);
+}
+
+void vk::UploadQueue::flushIfLarge()
+{
+    if (recording->stagingSize >= maxBatchStagingSize)
+    {
+        submit();
+        recycleComplete();
+    }
+}
@@ -0,0 +1,84 @@
+/*
+    Copyright (c) Aleksey Fedotov
+    MIT license
+*/
+
+#pragma once
+
+#include "Vulkan.h"
+#include "VulkanStagingPool.h"
+#include <vector>
+#include <mutex>
+
+namespace vk
+{
+    // Records buffer and image uploads into one command buffer per batch instead of submitting and waiting for each.
+    // Copies run on the transfer-only queue family if the device has one, resources are then released by it and
+    // acquired by the main queue family before anything submitted to the main queue afterwards. Batches are tracked
+    // with fences, their staging memory is reused once they're complete. Thread-safe.
+    class UploadQueue
+    {
+    public:
+        UploadQueue(VkDevice device, MemoryAllocator &allocator, VkQueue queue, uint32_t queueIndex,
+            VkQueue transferQueue, uint32_t transferQueueIndex, VkDeviceSize copyOffsetAlignment);
+        UploadQueue(const UploadQueue &other) = delete;
+        UploadQueue(UploadQueue &&other) = delete;
+        ~UploadQueue();
+
+        auto operator=(const UploadQueue &other) -> UploadQueue& = delete;
+        auto operator=(UploadQueue &&other) -> UploadQueue& = delete;
+
+        // Access and stages describe how the contents are read afterwards. Data is copied right away.
+        void uploadBuffer(VkBuffer buffer, const void *data, VkDeviceSize size,
+            VkAccessFlags dstAccess, VkPipelineStageFlags dstStages);
+        // All subresources of the image end up in the given layout. Texel size is in bytes, of a block for
+        // block-compressed formats.
+        void uploadImage(VkImage image, VkImageAspectFlags aspectMask, VkDeviceSize texelSize,
+            const void *data, VkDeviceSize size, const std::vector<VkBufferImageCopy> &regions, VkImageLayout layout,
+            VkAccessFlags dstAccess, VkPipelineStageFlags dstStages);
+
+        // Submits the batch being recorded, if any. Returns the id of the last submitted batch.
+        auto flush() -> uint64_t;
+        auto isComplete(uint64_t batchId) -> bool;
+        void wait(uint64_t batchId);
+        void waitIdle();
+
+        auto getStagingStats() -> StagingStats;
+
+    private:
+        struct Batch
+        {
+            uint64_t id = 0;
+            Resource<VkCommandBuffer> transferCmdBuf;
+            Resource<VkCommandBuffer> acquireCmdBuf; // only with a separate transfer family
+            Resource<VkSemaphore> semaphore; // same
+            Resource<VkFence> fence;
+            std::vector<VkBufferMemoryBarrier> bufferBarriers;
+            std::vector<VkImageMemoryBarrier> imageBarriers;
+            VkPipelineStageFlags dstStages = 0;
+            VkDeviceSize stagingSize = 0;
+        };
+
+        VkDevice device = nullptr;
+        VkQueue queue = nullptr;
+        VkQueue transferQueue = nullptr;
+        uint32_t queueIndex = 0;
+        uint32_t transferQueueIndex = 0;
+        Resource<VkCommandPool> transferCmdPool;
+        Resource<VkCommandPool> acquireCmdPool;
+        StagingPool stagingPool;
+        uptr<Batch> recording;
+        std::vector<uptr<Batch>> submitted; // in submission order
+        std::vector<uptr<Batch>> spare;
+        uint64_t nextBatchId = 1;
+        uint64_t lastSubmittedId = 0;
+        std::mutex mutex;
+
+        auto getRecordingBatch() -> Batch&;
+        auto allocateStaging(const void *data, VkDeviceSize size, VkDeviceSize texelSize) -> StagingRegion;
+        void submit();
+        void recycleComplete();
+        void flushIfLarge();
+        auto hasSeparateFamily() const -> bool { return queueIndex != transferQueueIndex; }
+    };
+}
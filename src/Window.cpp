@@ -18,7 +18,7 @@ Window::Window(uint32_t canvasWidth, uint32_t canvasHeight, const char *title)
     window = SDL_CreateWindow(title,
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
         canvasWidth, canvasHeight,
-        SDL_WINDOW_ALLOW_HIGHDPI);
+        SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE);
 }
 
 Window::~Window()
@@ -82,3 +82,9 @@ void Window::beginUpdate(Input &input)
 void Window::endUpdate()
 {
 }
+
+void Window::waitForEvents(uint32_t timeoutMs)
+{
+    // Leaves the event in the queue for the next beginUpdate()
+    SDL_WaitEventTimeout(nullptr, timeoutMs);
+}
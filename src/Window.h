@@ -25,6 +25,8 @@ public:
 
     void beginUpdate(Input &input);
     void endUpdate();
+    // Blocks until there is an event to process or the timeout expires, e.g. while minimized
+    void waitForEvents(uint32_t timeoutMs);
 
     bool closeRequested() const { return _closeRequested; }
 
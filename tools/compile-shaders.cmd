@@ -1 +0,0 @@
-"./compile-shaders.py" "../assets/shaders"
\ No newline at end of file